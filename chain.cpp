@@ -0,0 +1,375 @@
+#include "chain.h"
+#include <math.h>
+#include <string.h>
+#include <assert.h>
+
+using namespace MathFunc;
+
+static double sinOf(double x) {
+	return sin(x);
+}
+static double cosOf(double x) {
+	return cos(x);
+}
+static Interval sinOf(const Interval& x) {
+	return isin(x);
+}
+static Interval cosOf(const Interval& x) {
+	return icos(x);
+}
+
+//a I + b K + g a a^T for the unit axis (x, y, z), K its cross product
+//matrix. The rotation is (cos, sin, 1 - cos), its derivative by the
+//angle (-sin, cos, sin).
+template<class T> static void rotMat(const T& a, const T& b, const T& g, const JointDesc& d, T m[3][4]) {
+	const double x = d.x, y = d.y, z = d.z;
+	m[0][0] = a + g * (x * x);
+	m[0][1] = g * (x * y) - b * z;
+	m[0][2] = g * (x * z) + b * y;
+	m[1][0] = g * (y * x) + b * z;
+	m[1][1] = a + g * (y * y);
+	m[1][2] = g * (y * z) - b * x;
+	m[2][0] = g * (z * x) - b * y;
+	m[2][1] = g * (z * y) + b * x;
+	m[2][2] = a + g * (z * z);
+	m[0][3] = m[1][3] = m[2][3] = T(0);
+}
+
+//Local transform of a link as a 3 x 4 affine matrix
+template<class T> static void linkMat(const JointDesc& d, const T* theta, T m[3][4]) {
+	T s, c;
+	int i, j;
+	switch(d.type) {
+	case JOINT_ROT_VAR:
+		s = sinOf(theta[d.var]);
+		c = cosOf(theta[d.var]);
+		rotMat(c, s, T(1) - c, d, m);
+		break;
+	case JOINT_ROT_CONST:
+		s = T(sin(d.angle));
+		c = T(cos(d.angle));
+		rotMat(c, s, T(1) - c, d, m);
+		break;
+	case JOINT_TRANS_CONST:
+		for(i = 0; i < 3; i++) {
+			for(j = 0; j < 3; j++) {
+				m[i][j] = T(i == j);
+			}
+		}
+		m[0][3] = T(d.x);
+		m[1][3] = T(d.y);
+		m[2][3] = T(d.z);
+		break;
+	}
+}
+
+//p = m p, w is 1 for points and 0 for directions
+template<class T> static void apply(const T m[3][4], T* p, double w) {
+	T r[3];
+	int i;
+	for(i = 0; i < 3; i++) {
+		r[i] = m[i][0] * p[0] + m[i][1] * p[1] + m[i][2] * p[2] + m[i][3] * T(w);
+	}
+	p[0] = r[0];
+	p[1] = r[1];
+	p[2] = r[2];
+}
+
+//Right to left, a matrix-vector product per link
+template<class T> static void endPoint(const std::vector<JointDesc>& links, const T* theta, const double* init, T* pos) {
+	T m[3][4];
+	int k;
+	pos[0] = T(init[0]);
+	pos[1] = T(init[1]);
+	pos[2] = T(init[2]);
+	for(k = (int)links.size() - 1; k >= 0; k--) {
+		if(links[k].type == JOINT_TRANS_CONST) {
+			pos[0] = pos[0] + T(links[k].x);
+			pos[1] = pos[1] + T(links[k].y);
+			pos[2] = pos[2] + T(links[k].z);
+			continue;
+		}
+		linkMat(links[k], theta, m);
+		apply(m, pos, 1);
+	}
+}
+
+Chain::Chain() {}
+
+void Chain::pushRotV(int varid, double x, double y, double z) {
+	JointDesc d;
+	double len = sqrt(x * x + y * y + z * z);
+	assert(len > 0 && varid >= 0);
+	d.type = JOINT_ROT_VAR;
+	d.var = varid;
+	d.angle = 0;
+	d.x = x / len; d.y = y / len; d.z = z / len;
+	links.push_back(d);
+}
+
+void Chain::pushRotC(double angle, double x, double y, double z) {
+	JointDesc d;
+	double len = sqrt(x * x + y * y + z * z);
+	assert(len > 0);
+	d.type = JOINT_ROT_CONST;
+	d.var = -1;
+	d.angle = angle;
+	d.x = x / len; d.y = y / len; d.z = z / len;
+	links.push_back(d);
+}
+
+void Chain::pushTransC(double x, double y, double z) {
+	JointDesc d;
+	d.type = JOINT_TRANS_CONST;
+	d.var = -1;
+	d.angle = 0;
+	d.x = x; d.y = y; d.z = z;
+	links.push_back(d);
+}
+
+void Chain::clear() {
+	links.clear();
+}
+
+int Chain::size() const {
+	return (int)links.size();
+}
+
+bool Chain::empty() const {
+	return links.empty();
+}
+
+const JointDesc& Chain::operator[](int idx) const {
+	return links[idx];
+}
+
+int Chain::vars() const {
+	int i, ret = 0;
+	for(i = 0; i < (int)links.size(); i++) {
+		if(links[i].type == JOINT_ROT_VAR && links[i].var + 1 > ret) {
+			ret = links[i].var + 1;
+		}
+	}
+	return ret;
+}
+
+void Chain::eval(const double* theta, const double* init, double* pos) const {
+	endPoint(links, theta, init, pos);
+}
+
+void Chain::evalInterval(const Interval* box, const double* init, Interval* pos) const {
+	endPoint(links, box, init, pos);
+}
+
+//With s_k = L_k ... L_n-1 init and P_k = L_0 ... L_k-1, the partial by
+//the angle of link k is P_k dL_k s_k+1. One backward sweep collects the
+//s_k, one forward sweep the prefixes.
+void Chain::jacobian(const double* theta, int nv, const double* init, double* pos, double* jac, int stride) const {
+	const int n = (int)links.size();
+	double s[CHAIN_MAX_LINKS + 1][3], l[CHAIN_MAX_LINKS][3][4];
+	double sn[CHAIN_MAX_LINKS], cs[CHAIN_MAX_LINKS];
+	double p[3][4], t[3][4], dl[3][4], v[3];
+	int i, j, k;
+	assert(n <= CHAIN_MAX_LINKS);
+
+	for(i = 0; i < 3; i++) {
+		s[n][i] = init[i];
+		for(j = 0; j < nv; j++) {
+			jac[i * stride + j] = 0;
+		}
+	}
+	for(k = n - 1; k >= 0; k--) {
+		const JointDesc& d = links[k];
+		s[k][0] = s[k + 1][0]; s[k][1] = s[k + 1][1]; s[k][2] = s[k + 1][2];
+		if(d.type == JOINT_TRANS_CONST) {
+			s[k][0] += d.x; s[k][1] += d.y; s[k][2] += d.z;
+			continue;
+		}
+		if(d.type == JOINT_ROT_VAR) {
+			sn[k] = sin(theta[d.var]);
+			cs[k] = cos(theta[d.var]);
+		}
+		else {
+			sn[k] = sin(d.angle);
+			cs[k] = cos(d.angle);
+		}
+		rotMat(cs[k], sn[k], 1 - cs[k], d, l[k]);
+		apply(l[k], s[k], 1);
+	}
+	pos[0] = s[0][0]; pos[1] = s[0][1]; pos[2] = s[0][2];
+
+	for(i = 0; i < 3; i++) {
+		for(j = 0; j < 4; j++) {
+			p[i][j] = i == j;
+		}
+	}
+	for(k = 0; k < n; k++) {
+		//Translation only moves the prefix origin
+		if(links[k].type == JOINT_TRANS_CONST) {
+			for(i = 0; i < 3; i++) {
+				p[i][3] += p[i][0] * links[k].x + p[i][1] * links[k].y + p[i][2] * links[k].z;
+			}
+			continue;
+		}
+		if(links[k].type == JOINT_ROT_VAR && links[k].var < nv) {
+			rotMat(-sn[k], cs[k], sn[k], links[k], dl);
+			v[0] = s[k + 1][0]; v[1] = s[k + 1][1]; v[2] = s[k + 1][2];
+			apply(dl, v, 0);
+			apply(p, v, 0);
+			for(i = 0; i < 3; i++) {
+				jac[i * stride + links[k].var] += v[i];
+			}
+		}
+		//p = p l_k
+		for(i = 0; i < 3; i++) {
+			for(j = 0; j < 4; j++) {
+				t[i][j] = p[i][0] * l[k][0][j] + p[i][1] * l[k][1][j] + p[i][2] * l[k][2][j] + (j == 3 ? p[i][3] : 0);
+			}
+		}
+		memcpy(p, t, sizeof(p));
+	}
+}
+
+void Chain::geometric(const double* theta, int nv, const double* init, double* pos, double* jac, int stride) const {
+	pose(theta, nv, init, pos, NULL, jac, stride);
+}
+
+int Chain::frames(const double* theta, int nv, const double* init, double* pos, double* rot, double (*axis)[3], double (*org)[3], int* var) const {
+	const int n = (int)links.size();
+	double p[3][4], r[3][4], t[3][3], sn, cs;
+	int i, j, k, m = 0;
+
+	for(i = 0; i < 3; i++) {
+		for(j = 0; j < 4; j++) {
+			p[i][j] = i == j;
+		}
+	}
+	for(k = 0; k < n; k++) {
+		const JointDesc& d = links[k];
+		if(d.type == JOINT_TRANS_CONST) {
+			for(i = 0; i < 3; i++) {
+				p[i][3] += p[i][0] * d.x + p[i][1] * d.y + p[i][2] * d.z;
+			}
+			continue;
+		}
+		//The joint turns about its axis through the current origin
+		if(axis && d.type == JOINT_ROT_VAR && d.var < nv) {
+			for(i = 0; i < 3; i++) {
+				axis[m][i] = p[i][0] * d.x + p[i][1] * d.y + p[i][2] * d.z;
+				org[m][i] = p[i][3];
+			}
+			var[m++] = d.var;
+		}
+		if(d.type == JOINT_ROT_VAR) {
+			sn = sin(theta[d.var]);
+			cs = cos(theta[d.var]);
+		}
+		else {
+			sn = sin(d.angle);
+			cs = cos(d.angle);
+		}
+		rotMat(cs, sn, 1 - cs, d, r);
+		for(i = 0; i < 3; i++) {
+			for(j = 0; j < 3; j++) {
+				t[i][j] = p[i][0] * r[0][j] + p[i][1] * r[1][j] + p[i][2] * r[2][j];
+			}
+		}
+		for(i = 0; i < 3; i++) {
+			p[i][0] = t[i][0]; p[i][1] = t[i][1]; p[i][2] = t[i][2];
+		}
+	}
+	pos[0] = init[0]; pos[1] = init[1]; pos[2] = init[2];
+	apply(p, pos, 1);
+	if(rot) {
+		for(i = 0; i < 3; i++) {
+			for(j = 0; j < 3; j++) {
+				rot[i * 3 + j] = p[i][j];
+			}
+		}
+	}
+	return m;
+}
+
+void Chain::pose(const double* theta, int nv, const double* init, double* pos, double* rot, double* jac, int stride) const {
+	const int rows = rot ? 6 : 3;
+	double axis[CHAIN_MAX_LINKS][3], org[CHAIN_MAX_LINKS][3], e[3];
+	int var[CHAIN_MAX_LINKS];
+	int i, j, k, m;
+	assert((int)links.size() <= CHAIN_MAX_LINKS);
+
+	if(!jac) {
+		frames(theta, nv, init, pos, rot, NULL, NULL, NULL);
+		return;
+	}
+	m = frames(theta, nv, init, pos, rot, axis, org, var);
+	for(i = 0; i < rows; i++) {
+		for(j = 0; j < nv; j++) {
+			jac[i * stride + j] = 0;
+		}
+	}
+	for(k = 0; k < m; k++) {
+		for(i = 0; i < 3; i++) {
+			e[i] = pos[i] - org[k][i];
+		}
+		jac[var[k]] += axis[k][1] * e[2] - axis[k][2] * e[1];
+		jac[stride + var[k]] += axis[k][2] * e[0] - axis[k][0] * e[2];
+		jac[2 * stride + var[k]] += axis[k][0] * e[1] - axis[k][1] * e[0];
+	}
+	if(!rot) {
+		return;
+	}
+	//The end frame turns with the angular velocity of each axis
+	for(k = 0; k < m; k++) {
+		for(i = 0; i < 3; i++) {
+			jac[(3 + i) * stride + var[k]] += axis[k][i];
+		}
+	}
+}
+
+Linear::Mat<ExprP> Chain::symbolic() const {
+	Linear::Mat<ExprP> ret(4, 4), m(4, 4);
+	ExprP s, c;
+	int i, j, k;
+	for(i = 0; i < 4; i++) {
+		for(j = 0; j < 4; j++) {
+			ret[i][j] = (i == j);
+		}
+	}
+	for(k = 0; k < (int)links.size(); k++) {
+		const JointDesc& d = links[k];
+		for(i = 0; i < 4; i++) {
+			for(j = 0; j < 4; j++) {
+				m[i][j] = (i == j);
+			}
+		}
+		switch(d.type) {
+		case JOINT_ROT_VAR:
+		case JOINT_ROT_CONST:
+			if(d.type == JOINT_ROT_VAR) {
+				s = SinFunc(d.var);
+				c = CosFunc(d.var);
+			}
+			else {
+				s = sin(d.angle);
+				c = cos(d.angle);
+			}
+			m[0][0] = d.x * d.x * (1.0 - c) + c;
+			m[0][1] = d.x * d.y * (1.0 - c) - d.z * s;
+			m[0][2] = d.x * d.z * (1.0 - c) + d.y * s;
+			m[1][0] = d.y * d.x * (1.0 - c) + d.z * s;
+			m[1][1] = d.y * d.y * (1.0 - c) + c;
+			m[1][2] = d.y * d.z * (1.0 - c) - d.x * s;
+			m[2][0] = d.x * d.z * (1.0 - c) - d.y * s;
+			m[2][1] = d.y * d.z * (1.0 - c) + d.x * s;
+			m[2][2] = d.z * d.z * (1.0 - c) + c;
+			break;
+		case JOINT_TRANS_CONST:
+			m[0][3] = d.x;
+			m[1][3] = d.y;
+			m[2][3] = d.z;
+			break;
+		}
+		ret *= m;
+	}
+	return ret;
+}
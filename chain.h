@@ -0,0 +1,77 @@
+#ifndef __CHAIN_HEADER__
+#define __CHAIN_HEADER__
+
+#include "linearalgebra.h"
+#include "mathfunc.h"
+#include "interval.h"
+#include <vector>
+
+//Links a single Chain evaluates with fixed size stack memory
+#define CHAIN_MAX_LINKS (128)
+
+enum JointType {
+	//Rotation by a joint variable about a fixed axis
+	JOINT_ROT_VAR = 0,
+	//Rotation by a constant angle
+	JOINT_ROT_CONST,
+	//Constant translation
+	JOINT_TRANS_CONST
+};
+
+//One link of a kinematic chain
+struct JointDesc {
+	JointType type;
+	//Joint variable of JOINT_ROT_VAR
+	int var;
+	//Angle of JOINT_ROT_CONST
+	double angle;
+	//Unit rotation axis, or the translation
+	double x, y, z;
+};
+
+//Kinematic chain as the list of its links, applied in push order: the
+//end point is L0 L1 ... Ln-1 init. Evaluated numerically, so its cost
+//grows linearly with the links instead of with a symbolic product.
+class Chain {
+public:
+	Chain();
+
+	void pushRotV(int varid, double x, double y, double z);
+	void pushRotC(double angle, double x, double y, double z);
+	void pushTransC(double x, double y, double z);
+	void clear();
+
+	int size() const;
+	bool empty() const;
+	const JointDesc& operator[](int idx) const;
+	//Highest joint variable used, plus one
+	int vars() const;
+
+	//End position of init, x y z
+	void eval(const double* theta, const double* init, double* pos) const;
+	//Position and its x, y, z rows of partials by the nv joint
+	//variables, row i of jac starts at jac + i * stride
+	void jacobian(const double* theta, int nv, const double* init, double* pos, double* jac, int stride) const;
+	//Same result from the world frames of one forward pass, column i is
+	//the sum of axis x (end - joint origin) over the joints of theta[i]
+	void geometric(const double* theta, int nv, const double* init, double* pos, double* jac, int stride) const;
+	//Also the end rotation into rot, 3 x 3 row major, and below the
+	//position rows of jac its angular velocity rows, six in all. With
+	//rot NULL this is geometric, with jac NULL only the pose is made.
+	void pose(const double* theta, int nv, const double* init, double* pos, double* rot, double* jac, int stride) const;
+	//End position and rotation (3 x 3 row major, or NULL) of one forward
+	//pass. With axis non-NULL the world axis and origin of every joint of
+	//the nv variables are also written, base first, with the variable
+	//in var. Returns the number of those joints.
+	int frames(const double* theta, int nv, const double* init, double* pos, double* rot, double (*axis)[3], double (*org)[3], int* var) const;
+	//Enclosure of the end position while theta[i] ranges over box[i]
+	void evalInterval(const Interval* box, const double* init, Interval* pos) const;
+
+	//The same transformation as a symbolic 4 x 4 matrix
+	Linear::Mat<MathFunc::ExprP> symbolic() const;
+
+private:
+	std::vector<JointDesc> links;
+};
+
+#endif
@@ -27,7 +27,7 @@ RealVec RealVec::norm() const {
 	double len = this->modulus();
 	assert(!this->zero());
 	for(i = 0; i < dimension; i++) {
-		ret.data[i] /= len;
+		ret.data[i] = data[i] / len;
 	}
 	return ret;
 }
@@ -0,0 +1,188 @@
+#include "exprio.h"
+#include <string.h>
+#include <unordered_map>
+
+using namespace MathFunc;
+
+typedef std::unordered_map<const Expr*, int> IndexMap;
+
+static void put(std::vector<unsigned char>& buf, const void* p, size_t n) {
+	const unsigned char* b = (const unsigned char*)p;
+	buf.insert(buf.end(), b, b + n);
+}
+
+static void putInt(std::vector<unsigned char>& buf, int v) {
+	put(buf, &v, sizeof(v));
+}
+
+//Writes e after its operands, returns its index
+static int writeNode(const ExprP& e, std::vector<unsigned char>& buf, IndexMap& index) {
+	IndexMap::iterator it = index.find(e.get());
+	const BinaryFunc* b;
+	unsigned char type;
+	double c;
+	int l, r;
+	if(it != index.end()) {
+		return it->second;
+	}
+	type = (unsigned char)e->type();
+	switch(e->type()) {
+	case EXPR_CONST:
+		c = ((const ConstFunc*)e.get())->value();
+		buf.push_back(type);
+		put(buf, &c, sizeof(c));
+		break;
+	case EXPR_SIN:
+	case EXPR_COS:
+	case EXPR_X:
+		buf.push_back(type);
+		putInt(buf, ((const VarFunc*)e.get())->var());
+		break;
+	case EXPR_ADD:
+	case EXPR_MINUS:
+	case EXPR_MULT:
+		b = (const BinaryFunc*)e.get();
+		l = writeNode(b->left(), buf, index);
+		r = writeNode(b->right(), buf, index);
+		buf.push_back(type);
+		putInt(buf, l);
+		putInt(buf, r);
+		break;
+	case EXPR_UMINUS:
+		l = writeNode(((const unaryMinus*)e.get())->operand(), buf, index);
+		buf.push_back(type);
+		putInt(buf, l);
+		break;
+	}
+	l = (int)index.size();
+	index[e.get()] = l;
+	return l;
+}
+
+void MathFunc::serialize(const ExprP* es, int n, std::vector<unsigned char>& buf) {
+	std::vector<unsigned char> nodes;
+	std::vector<int> roots(n);
+	IndexMap index;
+	int i;
+	for(i = 0; i < n; i++) {
+		roots[i] = writeNode(es[i], nodes, index);
+	}
+	buf.clear();
+	putInt(buf, (int)index.size());
+	buf.insert(buf.end(), nodes.begin(), nodes.end());
+	putInt(buf, n);
+	for(i = 0; i < n; i++) {
+		putInt(buf, roots[i]);
+	}
+}
+
+//Bounds checked reader over a serialized buffer
+struct ExprReader {
+	const unsigned char* p;
+	const unsigned char* end;
+
+	bool get(void* out, size_t n) {
+		if((size_t)(end - p) < n) {
+			return false;
+		}
+		memcpy(out, p, n);
+		p += n;
+		return true;
+	}
+	bool getInt(int& v) {
+		return get(&v, sizeof(v));
+	}
+	bool getIndex(int& v, int limit) {
+		return getInt(v) && v >= 0 && v < limit;
+	}
+};
+
+bool MathFunc::deserialize(const unsigned char* buf, size_t len, ExprP* es, int n, int vars) {
+	ExprReader in;
+	std::vector<ExprP> nodes;
+	unsigned char type;
+	double c;
+	int count, i, a, b;
+	in.p = buf;
+	in.end = buf + len;
+
+	//Every node takes its type and at least an int, so a count the
+	//buffer cannot hold is rejected before anything is allocated
+	if(!in.getInt(count) || count < 0 || (size_t)count > (size_t)(in.end - in.p) / (1 + sizeof(int))) {
+		return false;
+	}
+	nodes.reserve(count);
+	for(i = 0; i < count; i++) {
+		if(!in.get(&type, 1)) {
+			return false;
+		}
+		switch(type) {
+		case EXPR_CONST:
+			if(!in.get(&c, sizeof(c))) {
+				return false;
+			}
+			nodes.push_back(ConstFunc(c));
+			break;
+		case EXPR_SIN:
+		case EXPR_COS:
+		case EXPR_X:
+			if(!in.getIndex(a, vars)) {
+				return false;
+			}
+			if(type == EXPR_SIN) {
+				nodes.push_back(SinFunc(a));
+			}
+			else if(type == EXPR_COS) {
+				nodes.push_back(CosFunc(a));
+			}
+			else {
+				nodes.push_back(XFunc(a));
+			}
+			break;
+		case EXPR_ADD:
+		case EXPR_MINUS:
+		case EXPR_MULT:
+			if(!in.getIndex(a, i) || !in.getIndex(b, i)) {
+				return false;
+			}
+			if(type == EXPR_ADD) {
+				nodes.push_back(Add(nodes[a], nodes[b]));
+			}
+			else if(type == EXPR_MINUS) {
+				nodes.push_back(Minus(nodes[a], nodes[b]));
+			}
+			else {
+				nodes.push_back(Mult(nodes[a], nodes[b]));
+			}
+			break;
+		case EXPR_UMINUS:
+			if(!in.getIndex(a, i)) {
+				return false;
+			}
+			nodes.push_back(unaryMinus(nodes[a]));
+			break;
+		default:
+			return false;
+		}
+	}
+
+	if(!in.getInt(a) || a != n) {
+		return false;
+	}
+	for(i = 0; i < n; i++) {
+		if(!in.getIndex(a, count)) {
+			return false;
+		}
+		es[i] = nodes[a];
+	}
+	return in.p == in.end;
+}
+
+unsigned int MathFunc::contentHash(const unsigned char* buf, size_t len, unsigned int seed) {
+	unsigned int h = seed;
+	size_t i;
+	for(i = 0; i < len; i++) {
+		h = (h ^ buf[i]) * 16777619u;
+	}
+	return h;
+}
@@ -0,0 +1,23 @@
+#ifndef __EXPRIO_HEADER__
+#define __EXPRIO_HEADER__
+
+#include "mathfunc.h"
+#include <stddef.h>
+#include <vector>
+
+namespace MathFunc {
+	//Compact binary form of a batch of expressions. Every distinct node
+	//is written once, operands before users, and refers to its operands
+	//by index, so shared subexpressions stay shared when read back.
+	//Doubles and ints are stored in host byte order, the format is meant
+	//for caches on the same machine.
+	void serialize(const ExprP* es, int n, std::vector<unsigned char>& buf);
+	//Reads n roots back into es, false if buf is malformed, holds a
+	//different number of roots or a variable not below vars
+	bool deserialize(const unsigned char* buf, size_t len, ExprP* es, int n, int vars);
+
+	//FNV-1a over a buffer, stable between runs unlike Expr::hash()
+	unsigned int contentHash(const unsigned char* buf, size_t len, unsigned int seed = 2166136261u);
+}
+
+#endif
@@ -7,8 +7,45 @@
 
 #include "modelerglobals.h"
 #include "jacobian.h"
+#include "iksolver.h"
+#include "gundanik.h"
+#include "gundanleg_gen.h"
 typedef Vec3<double> v3;
 #define PI 3.14159265
+//Targets farther than this from every reachable foot position are
+//not solved for
+#define IK_REACH_TOL 0.05
+//Immediate solves stop at this distance, step count or time in ms
+#define IK_TOL 1e-4
+#define IK_MAX_ITERS 200
+#define IK_TIME_BUDGET 20.0
+//Radians of foot tilt worth one unit of distance with flat feet
+#define IK_FOOT_WEIGHT 0.5
+
+//Effectors of the IK solver, in the order initJacobian adds them
+enum GundanLimb {
+	LIMB_LLEG = 0, LIMB_RLEG, LIMB_LARM, LIMB_RARM,
+	LIMB_COUNT
+};
+//Joint sliders of each limb in variable order
+static const int limbJoints[LIMB_COUNT][3] = {
+	{LLEGZ, LLEGX, LSHANKZ}, {RLEGZ, RLEGX, RSHANKZ}, {LHANDX, LHANDZ, -1}, {RHANDX, RHANDZ, -1}
+};
+//and target sliders
+static const int limbTargets[LIMB_COUNT][3] = {
+	{IKX, IKY, IKZ}, {RLIKX, RLIKY, RLIKZ}, {LAIKX, LAIKY, LAIKZ}, {RAIKX, RAIKY, RAIKZ}
+};
+
+//and the switches that let the IK move them
+static const int limbEnable[LIMB_COUNT] = {IKLLEG, IKRLEG, IKLARM, IKRARM};
+
+//Sliders persistent IK solves again for when one of them moves
+static const int ikInputs[] = {
+	IKX, IKY, IKZ, RLIKX, RLIKY, RLIKZ, LAIKX, LAIKY, LAIKZ, RAIKX, RAIKY, RAIKZ,
+	LLEGXMAX, LLEGXMIN, LLEGZMAX, LLEGZMIN, LSHANKZMAX, LSHANKZMIN, FLATFEET, IKMETHOD, PIK,
+	IKLLEG, IKRLEG, IKLARM, IKRARM
+};
+#define IK_INPUTS ((int)(sizeof(ikInputs) / sizeof(ikInputs[0])))
 
 #define SETVAL(x, v) (ModelerApplication::Instance()->SetControlValue(x, v))
 
@@ -17,8 +54,11 @@ class Gundan : public ModelerView
 {
 public:
     Gundan(int x, int y, int w, int h, char *label) 
-        : ModelerView(x,y,w,h,label), left_feet(NULL), IK_flag(false) {
+        : ModelerView(x,y,w,h,label), limbs(NULL), IK_flag(false) {
 			initJacobian();
+			for(int i = 0; i < IK_INPUTS; i++) {
+				ik_inputs[i] = -1e30;
+			}
 	}
     virtual void draw();
 	static Gundan *instance;
@@ -39,9 +79,15 @@ private:
 	static void updateIK(void*);
 	bool updateIKR(int);
 	void drawGoal();
+	RealVec limbTheta(int limb);
+	void setLimbTheta(int limb, const RealVec& t);
+	RealVec limbTarget(int limb);
+	bool ikInputsChanged();
 
-	Jacobian *left_feet;
+	IKSolver *limbs;
 	bool IK_flag;
+	//ikInputs as of the last redraw
+	double ik_inputs[IK_INPUTS];
 };
 
 Gundan *Gundan::instance = NULL;
@@ -451,11 +497,14 @@ void Gundan::drawSword()
 void Gundan::draw()
 {
     ModelerView::draw();
-	if(VAL(IK) || VAL(PIK)) {
+	//Persistent IK only solves again once its sliders move, not on
+	//every redraw
+	bool changed = ikInputsChanged();
+	if(VAL(IK) || (VAL(PIK) && changed)) {
 		beginIK();
 	}
 	setAmbientColor(.1f,.1f,.1f);
-	if(IK_flag) {
+	if(IK_flag || VAL(PIK)) {
 		drawGoal();
 	}
 	int level = VAL(LEVEL);
@@ -502,70 +551,129 @@ void Gundan::draw()
 }
 
 void Gundan::initJacobian() {
-	//Reconstruct transformation
-	left_feet = new Jacobian(3);
-
-	//LLEGZ: 0, LLEGX: 1, LSHANKZ: 2
-
-	/*
-	//Thigh
-	left_feet->pushTransC(-0.1, -1.6, 0);
-	left_feet->pushRotV(0, -1.0, 0.0, 0.0);
-	left_feet->pushRotV(1, 0.0, 0.0, -1.0);
-	left_feet->pushTransC(-0.3, -1.6, 0);
+	Jacobian* left_feet = createLeftLeg();
+	left_feet->setCache("gundanleg.jcache");
+	left_feet->setCompiled(leftLegJacobian, LEFTLEGJACOBIAN_HASH);
+
+	limbs = new IKSolver(LIMB_COUNT);
+	limbs->addEffector(left_feet);
+	limbs->addEffector(createRightLeg());
+	limbs->addEffector(createLeftArm());
+	limbs->addEffector(createRightArm());
+
+	//The left leg has limit sliders, the other limbs the slider ranges
+	limbs->effector(LIMB_RLEG)->setConstraint(0, -80 / 180.0 * PI, 80 / 180.0 * PI);
+	limbs->effector(LIMB_RLEG)->setConstraint(1, 0, 60 / 180.0 * PI);
+	limbs->effector(LIMB_RLEG)->setConstraint(2, 0, 120 / 180.0 * PI);
+	limbs->effector(LIMB_LARM)->setConstraint(0, 0, 70 / 180.0 * PI);
+	limbs->effector(LIMB_LARM)->setConstraint(1, -80 / 180.0 * PI, 80 / 180.0 * PI);
+	limbs->effector(LIMB_RARM)->setConstraint(0, 0, 70 / 180.0 * PI);
+	limbs->effector(LIMB_RARM)->setConstraint(1, -80 / 180.0 * PI, 80 / 180.0 * PI);
+	//Feet and hands often end at a limit, which clamping creeps up on
+	for(int i = 0; i < LIMB_COUNT; i++) {
+		limbs->effector(i)->useNullSpace(true);
+	}
+}
 
-	//Shank
-	
-	left_feet->pushRotV(2, 1.0, 0.0, 0.0); 
-	left_feet->pushTransC(0.2, -2.5, -0.25);*/
+RealVec Gundan::limbTheta(int limb) {
+	RealVec t(limbs->effector(limb)->dof());
+	int i;
+	for(i = 0; i < t.dim(); i++) {
+		t[i] = VAL(limbJoints[limb][i]) / 180.0 * PI;
+	}
+	return t;
+}
 
-	left_feet->setTrans(0, 0, CosFunc(1));
-	left_feet->setTrans(0, 1, CosFunc(2) * SinFunc(1));
-	left_feet->setTrans(0, 2, - SinFunc(2) * SinFunc(1));
-	left_feet->setTrans(0, 3, -0.1 - 0.1 * CosFunc(1) + SinFunc(1) * (-1.6 - 2.5 * CosFunc(2) + 0.25 * SinFunc(2)));
-	
-	left_feet->setTrans(1, 0, - CosFunc(0) * SinFunc(1));
-	left_feet->setTrans(1, 1, CosFunc(0) * CosFunc(1) * CosFunc(2) + SinFunc(0) * SinFunc(2));
-	left_feet->setTrans(1, 2, CosFunc(2) * SinFunc(0) - CosFunc(0) * CosFunc(1) * SinFunc(2));
-	left_feet->setTrans(1, 3, -1.6 + CosFunc(0) * (0.1 * SinFunc(1) + CosFunc(1) * (-1.6-2.5 * CosFunc(2) + 0.25 * SinFunc(2))) + SinFunc(0) * (-0.25 * CosFunc(2) - 2.5 * SinFunc(2)));
-	
-	left_feet->setTrans(2, 0, SinFunc(0) * SinFunc(1));
-	left_feet->setTrans(2, 1, - CosFunc(1) * CosFunc(2) * SinFunc(0) + CosFunc(0) * SinFunc(2));
-	left_feet->setTrans(2, 2, CosFunc(0) * CosFunc(2) + CosFunc(1) * SinFunc(0) * SinFunc(2));
-	left_feet->setTrans(2, 3, SinFunc(0) * (-0.1 * SinFunc(1) + CosFunc(1) * (1.6 + 2.5 * CosFunc(2) - 0.25 * SinFunc(2))) + CosFunc(0) * (-0.25 * CosFunc(2) - 2.5 * SinFunc(2)));
-	
-	left_feet->setTrans(3, 0, ConstFunc(0));
-	left_feet->setTrans(3, 1, ConstFunc(0));
-	left_feet->setTrans(3, 2, ConstFunc(0));
-	left_feet->setTrans(3, 3, ConstFunc(1));
+void Gundan::setLimbTheta(int limb, const RealVec& t) {
+	int i;
+	for(i = 0; i < t.dim(); i++) {
+		SETVAL(limbJoints[limb][i], t[i] * 180.0 / PI);
+	}
+}
 
+RealVec Gundan::limbTarget(int limb) {
+	double x = VAL(limbTargets[limb][0]), y = VAL(limbTargets[limb][1]), z = VAL(limbTargets[limb][2]);
+	switch(limb) {
+	case LIMB_LLEG:
+		return leftLegTarget(x, y, z);
+	case LIMB_RLEG:
+		return rightLegTarget(x, y, z);
+	case LIMB_LARM:
+		return leftArmTarget(x, y, z);
+	default:
+		return rightArmTarget(x, y, z);
+	}
+}
 
-	left_feet->setInitVec(-0.475, -0.75, 0.0);
+bool Gundan::ikInputsChanged() {
+	bool changed = false;
+	int i;
+	for(i = 0; i < IK_INPUTS; i++) {
+		if(VAL(ikInputs[i]) != ik_inputs[i]) {
+			ik_inputs[i] = VAL(ikInputs[i]);
+			changed = true;
+		}
+	}
+	return changed;
 }
 
 void Gundan::beginIK() {
-	SETVAL(LKNEEL, 0);
+	bool any = false;
+	int i;
+	//Legs left out of IK keep their kneel
+	if(VAL(IKLLEG)) {
+		SETVAL(LKNEEL, 0);
+	}
+	if(VAL(IKRLEG)) {
+		SETVAL(RKNEEL, 0);
+	}
 	SETVAL(IK, 0);
 	if(IK_flag == true) {
 		return;
 	}
 
 	//Set constraints
-	left_feet->setConstraint(0, VAL(LLEGZMIN) / 180.0 * PI, VAL(LLEGZMAX) / 180.0 * PI);
-	left_feet->setConstraint(1, VAL(LLEGXMIN) / 180.0 * PI, VAL(LLEGXMAX) / 180.0 * PI);
-	left_feet->setConstraint(2, VAL(LSHANKZMIN) / 180.0 * PI, VAL(LSHANKZMAX) / 180.0 * PI);
+	limbs->effector(LIMB_LLEG)->setConstraint(0, VAL(LLEGZMIN) / 180.0 * PI, VAL(LLEGZMAX) / 180.0 * PI);
+	limbs->effector(LIMB_LLEG)->setConstraint(1, VAL(LLEGXMIN) / 180.0 * PI, VAL(LLEGXMAX) / 180.0 * PI);
+	limbs->effector(LIMB_LLEG)->setConstraint(2, VAL(LSHANKZMIN) / 180.0 * PI, VAL(LSHANKZMAX) / 180.0 * PI);
+	//Limbs that are switched off keep their pose
+	for(i = 0; i < LIMB_COUNT; i++) {
+		limbs->setActive(i, VAL(limbEnable[i]) != 0);
+		limbs->setTarget(i, limbTarget(i));
+		limbs->setTheta(i, limbTheta(i));
+	}
+	//Feet at rest are level, so flat is the identity rotation
+	limbs->setOrientation(LIMB_LLEG, RealMat::id(3), VAL(FLATFEET) ? IK_FOOT_WEIGHT : 0);
+	limbs->setOrientation(LIMB_RLEG, RealMat::id(3), VAL(FLATFEET) ? IK_FOOT_WEIGHT : 0);
+	//0 is Jacobian::solve, then the IKMethodType values in order
+	limbs->setMethod(VAL(IKMETHOD) ? createIKMethod((IKMethodType)((int)VAL(IKMETHOD) - 1)) : NULL);
 	IK_flag = true;
 
-	//preprocess
-	left_feet->preprocess();
+	//Every limb on its own thread. Targets out of reach are skipped, the
+	//others start from the region the interval search found when it is
+	//closer than the current pose. Animated, only that seed is applied
+	//here and the timer takes the steps.
+	limbs->solveAll(IK_TOL, VAL(AIK) ? 0 : IK_MAX_ITERS, IK_TIME_BUDGET, IK_REACH_TOL);
+	for(i = 0; i < LIMB_COUNT; i++) {
+		if(VAL(limbEnable[i]) && !limbs->skipped(i)) {
+			setLimbTheta(i, limbs->theta(i));
+			any = true;
+		}
+	}
+	if(!VAL(AIK) || !any) {
+		IK_flag = false;
+		return;
+	}
 	Fl::add_timeout(0.025, Gundan::updateIK, (void*)1);
 	ModelerApplication::Instance()->m_animating = true;
 }
 
 void Gundan::updateIK(void* cnt) {
 	int c = (int)cnt;
-	if(VAL(PIK)) {
-		c = 1;
+	//Persistent IK keeps going with the longest step instead of
+	//starting over with the shortest on every tick
+	if(VAL(PIK) && c > 200) {
+		c = 200;
 	}
 	if((VAL(PIK) || c <= 200) && Gundan::instance->updateIKR(c)) {
 		Fl::add_timeout(0.025, Gundan::updateIK, (void*)(c+1));
@@ -577,29 +685,78 @@ void Gundan::updateIK(void* cnt) {
 }
 
 bool Gundan::updateIKR(int generation) {
-	RealVec t(3), r(4), c(4);
+	static const double flat[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+	const IKMethod* m = limbs->getMethod();
+	RealVec t, r, c(4), n;
 	double delta = 0.01 * sqrt(generation);
-	bool f=false;
+	bool f, all = true;
+	int i;
 	if(delta > 0.1) {
 		delta = 0.1;
 	}
-	t[0] = VAL(LLEGZ) / 180.0 * PI; t[1] = VAL(LLEGX) / 180.0 * PI; t[2] = VAL(LSHANKZ) / 180.0 * PI;
-	r[0] = -VAL(IKX) / 10.0 - 0.675; r[1] = VAL(IKY) / 10.3 - 6.38; r[2] = VAL(IKZ) / 11.0 - 0.25; r[3] = 1;
-	t = left_feet->stepDelta(t, r, delta, f);
-	c = left_feet->evalTrans(t) - r;
-	if(c.modulus() < 1e-4) {
-		f = true;
+	for(i = 0; i < LIMB_COUNT; i++) {
+		if(!VAL(limbEnable[i]) || limbs->skipped(i)) {
+			continue;
+		}
+		f = false;
+		t = limbTheta(i);
+		r = limbTarget(i);
+		//A leg cannot meet both goals exactly, it stops where the steps do
+		if(VAL(FLATFEET) && (i == LIMB_LLEG || i == LIMB_RLEG)) {
+			n = RealVec(t.dim());
+			limbs->effector(i)->stepPose(&t[0], &r[0], flat, IK_FOOT_WEIGHT, delta, &n[0], f);
+			setLimbTheta(i, n);
+			all = all && f;
+			continue;
+		}
+		//The chosen method takes its own full steps, one per tick
+		if(m) {
+			n = RealVec(t.dim());
+			m->step(*limbs->effector(i), &t[0], &r[0], &n[0]);
+			f = RealVec(n - t).modulus() == 0;
+			t = n;
+		}
+		else {
+			t = limbs->effector(i)->stepDelta(t, r, delta, f);
+		}
+		limbs->effector(i)->evalTrans(t, &c[0]);
+		if(RealVec(c - r).modulus() < 1e-4) {
+			f = true;
+		}
+		setLimbTheta(i, t);
+		all = all && f;
 	}
-	SETVAL(LLEGZ, t[0] * 180.0 / PI); SETVAL(LLEGX, t[1] * 180.0 / PI); SETVAL(LSHANKZ, t[2] * 180.0 / PI);
-	return !f;
+	return !all;
 }
 
 void Gundan::drawGoal() {
-	glPushMatrix();
-	glTranslated(-VAL(IKX) / 10.0 - 0.45, VAL(IKY) / 10.3 - 5.7, VAL(IKZ) / 11.0 + 0.1);
+	RealVec r;
+	int i;
 	setDiffuseColor(0.7f, 1.0f, 1.0f);
-	drawSphere(0.5);
-	glPopMatrix();
+	if(VAL(IKLLEG)) {
+		glPushMatrix();
+		glTranslated(-VAL(IKX) / 10.0 - 0.45, VAL(IKY) / 10.3 - 5.7, VAL(IKZ) / 11.0 + 0.1);
+		drawSphere(0.5);
+		glPopMatrix();
+	}
+	if(VAL(IKRLEG)) {
+		glPushMatrix();
+		glTranslated(VAL(RLIKX) / 10.0 + 0.45, VAL(RLIKY) / 10.3 - 5.7, VAL(RLIKZ) / 11.0 + 0.1);
+		drawSphere(0.5);
+		glPopMatrix();
+	}
+
+	//Arm goals in the frame drawBody leaves
+	for(i = LIMB_LARM; i <= LIMB_RARM; i++) {
+		if(!VAL(limbEnable[i])) {
+			continue;
+		}
+		r = limbTarget(i);
+		glPushMatrix();
+		glTranslated(r[0], r[1] + 0.5, r[2] + 0.51);
+		drawSphere(0.3);
+		glPopMatrix();
+	}
 }
 
 int main()
@@ -630,6 +787,23 @@ int main()
 	controls[LSHANKZMAX] = ModelerControl("left shank z max", 0, 120, 1, 120);
 	controls[IK] = ModelerControl("start inverse kinematics", 0, 1, 1, 0);
 	controls[PIK] = ModelerControl("persist inverse kinematics", 0, 1, 1, 0);
+	controls[AIK] = ModelerControl("animate inverse kinematics", 0, 1, 1, 0);
+	controls[RLIKX] = ModelerControl("right leg ik x", 0, 40, 1, 4);
+	controls[RLIKY] = ModelerControl("right leg ik y", 0, 40, 1, 0);
+	controls[RLIKZ] = ModelerControl("right leg ik z", -50, 50, 1, 0);
+	controls[LAIKX] = ModelerControl("left arm ik x", 0, 40, 1, 0);
+	controls[LAIKY] = ModelerControl("left arm ik y", 0, 40, 1, 0);
+	controls[LAIKZ] = ModelerControl("left arm ik z", -50, 50, 1, 0);
+	controls[RAIKX] = ModelerControl("right arm ik x", 0, 40, 1, 0);
+	controls[RAIKY] = ModelerControl("right arm ik y", 0, 40, 1, 0);
+	controls[RAIKZ] = ModelerControl("right arm ik z", -50, 50, 1, 0);
+	controls[FLATFEET] = ModelerControl("ik flat feet", 0, 1, 1, 0);
+	controls[IKMETHOD] = ModelerControl("ik method (jacobian, pinv, dls, ccd, fabrik)", 0, 4, 1, 0);
+	//The IK button used to pose the left foot alone
+	controls[IKLLEG] = ModelerControl("ik moves left leg", 0, 1, 1, 1);
+	controls[IKRLEG] = ModelerControl("ik moves right leg", 0, 1, 1, 0);
+	controls[IKLARM] = ModelerControl("ik moves left arm", 0, 1, 1, 0);
+	controls[IKRARM] = ModelerControl("ik moves right arm", 0, 1, 1, 0);
     ModelerApplication::Instance()->Init(&createGundan, controls, NUMCONTROLS);
     return ModelerApplication::Instance()->Run();
 }
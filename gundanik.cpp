@@ -0,0 +1,87 @@
+#include "gundanik.h"
+
+Jacobian* createLeftLeg() {
+	//Reconstruct transformation
+	Jacobian* left_feet = new Jacobian(3);
+
+	//LLEGZ: 0, LLEGX: 1, LSHANKZ: 2
+
+	//Thigh
+	left_feet->pushTransC(-0.1, -1.6, 0);
+	left_feet->pushRotV(0, -1.0, 0.0, 0.0);
+	left_feet->pushRotV(1, 0.0, 0.0, -1.0);
+	left_feet->pushTransC(-0.3, -1.6, 0);
+
+	//Shank
+	left_feet->pushRotV(2, 1.0, 0.0, 0.0);
+	left_feet->pushTransC(0.2, -2.5, -0.25);
+
+	left_feet->setInitVec(-0.475, -0.75, 0.0);
+	return left_feet;
+}
+
+RealVec leftLegTarget(double ikx, double iky, double ikz) {
+	RealVec r(4);
+	r[0] = -ikx / 10.0 - 0.675; r[1] = iky / 10.3 - 6.38; r[2] = ikz / 11.0 - 0.25; r[3] = 1;
+	return r;
+}
+
+Jacobian* createRightLeg() {
+	Jacobian* right_feet = new Jacobian(3);
+
+	//Thigh
+	right_feet->pushTransC(0.1, -1.6, 0);
+	right_feet->pushRotV(0, -1.0, 0.0, 0.0);
+	right_feet->pushRotV(1, 0.0, 0.0, 1.0);
+	right_feet->pushTransC(0.3, -1.6, 0);
+
+	//Shank
+	right_feet->pushRotV(2, 1.0, 0.0, 0.0);
+	right_feet->pushTransC(-0.2, -2.5, -0.25);
+
+	right_feet->setInitVec(0.475, -0.75, 0.0);
+	return right_feet;
+}
+
+RealVec rightLegTarget(double ikx, double iky, double ikz) {
+	RealVec r(4);
+	r[0] = ikx / 10.0 + 0.675; r[1] = iky / 10.3 - 6.38; r[2] = ikz / 11.0 - 0.25; r[3] = 1;
+	return r;
+}
+
+Jacobian* createLeftArm() {
+	Jacobian* left_hand = new Jacobian(2);
+
+	left_hand->pushTransC(-1.5, 1.2, -0.5);
+	left_hand->pushRotV(0, 0.0, 0.0, -1.0);
+	left_hand->pushRotV(1, -1.0, 0.0, 0.0);
+	left_hand->pushTransC(0, -3.5, -0.5);
+
+	//Middle of the fist
+	left_hand->setInitVec(-0.3, 0.0, 0.5);
+	return left_hand;
+}
+
+RealVec leftArmTarget(double ikx, double iky, double ikz) {
+	RealVec r(4);
+	r[0] = -ikx / 10.0 - 1.8; r[1] = iky / 10.0 - 2.3; r[2] = ikz / 10.0 - 0.5; r[3] = 1;
+	return r;
+}
+
+Jacobian* createRightArm() {
+	Jacobian* right_hand = new Jacobian(2);
+
+	right_hand->pushTransC(1.5, 1.2, -0.5);
+	right_hand->pushRotV(0, 0.0, 0.0, 1.0);
+	right_hand->pushRotV(1, 1.0, 0.0, 0.0);
+	right_hand->pushTransC(0, -3.5, -0.5);
+
+	right_hand->setInitVec(0.3, 0.0, 0.5);
+	return right_hand;
+}
+
+RealVec rightArmTarget(double ikx, double iky, double ikz) {
+	RealVec r(4);
+	r[0] = ikx / 10.0 + 1.8; r[1] = iky / 10.0 - 2.3; r[2] = ikz / 10.0 - 0.5; r[3] = 1;
+	return r;
+}
@@ -0,0 +1,27 @@
+#ifndef __GUNDANIK_HEADER__
+#define __GUNDANIK_HEADER__
+
+#include "jacobian.h"
+
+//Kinematic chains of the Gundan model, shared by the modeler and ikbench.
+//Legs are in the frame drawHip leaves, arms in the one drawBody leaves.
+
+//Variables: LLEGZ: 0, LLEGX: 1, LSHANKZ: 2
+Jacobian* createLeftLeg();
+
+//Homogeneous goal of the left foot for the IKX/IKY/IKZ slider values
+RealVec leftLegTarget(double ikx, double iky, double ikz);
+
+//Variables: RLEGZ: 0, RLEGX: 1, RSHANKZ: 2
+Jacobian* createRightLeg();
+RealVec rightLegTarget(double ikx, double iky, double ikz);
+
+//Variables: LHANDX: 0, LHANDZ: 1
+Jacobian* createLeftArm();
+RealVec leftArmTarget(double ikx, double iky, double ikz);
+
+//Variables: RHANDX: 0, RHANDZ: 1
+Jacobian* createRightArm();
+RealVec rightArmTarget(double ikx, double iky, double ikz);
+
+#endif
@@ -0,0 +1,184 @@
+// Generated by Jacobian::writeCpp, do not edit.
+// out: homogeneous position (4), then the partials that are not
+// structurally zero, row major:
+// d0/d1, d0/d2, d1/d0, d1/d1, d1/d2, d2/d0, d2/d1, d2/d2
+
+#ifndef __LEFTLEGJACOBIAN_GEN_HEADER__
+#define __LEFTLEGJACOBIAN_GEN_HEADER__
+
+#include <math.h>
+
+#define LEFTLEGJACOBIAN_DOF 3
+#define LEFTLEGJACOBIAN_PARTIALS 8
+#define LEFTLEGJACOBIAN_HASH 0xef8c9c81u
+
+inline void leftLegJacobian(const double* v, double* out) {
+	const double s0 = sin(v[0]), c0 = cos(v[0]);
+	const double s1 = sin(v[1]), c1 = cos(v[1]);
+	const double s2 = sin(v[2]), c2 = cos(v[2]);
+	const double r2 = c0;
+	const double r3 = 1 - r2;
+	const double r4 = r3 + r2;
+	const double r5 = c1;
+	const double r6 = r4 * r5;
+	const double r7 = c2;
+	const double r8 = 1 - r7;
+	const double r9 = r8 + r7;
+	const double r10 = r6 * r9;
+	const double r11 = (-0.47499999999999998) * r10;
+	const double r13 = s1;
+	const double r14 = r4 * r13;
+	const double r15 = r14 * r7;
+	const double r16 = (-0.75) * r15;
+	const double r17 = r11 + r16;
+	const double r19 = 0.20000000000000001 * r10;
+	const double r21 = (-2.5) * r15;
+	const double r22 = r19 + r21;
+	const double r24 = s2;
+	const double r25 = r14 * r24;
+	const double r26 = (-0.25) * r25;
+	const double r27 = r22 - r26;
+	const double r29 = (-0.29999999999999999) * r6;
+	const double r31 = (-1.6000000000000001) * r14;
+	const double r32 = r29 + r31;
+	const double r34 = r32 + (-0.10000000000000001);
+	const double r35 = r27 + r34;
+	const double r36 = r17 + r35;
+	const double r37 = r2 * r5;
+	const double r38 = r37 * r7;
+	const double r39 = s0;
+	const double r40 = 1 - r5;
+	const double r41 = r40 + r5;
+	const double r42 = r39 * r41;
+	const double r43 = r42 * r24;
+	const double r44 = r38 + r43;
+	const double r45 = (-0.75) * r44;
+	const double r46 = r2 * r13;
+	const double r47 = r46 * r9;
+	const double r48 = (-0.47499999999999998) * r47;
+	const double r49 = r45 - r48;
+	const double r50 = (-2.5) * r44;
+	const double r51 = 0.20000000000000001 * r47;
+	const double r52 = r50 - r51;
+	const double r53 = r42 * r7;
+	const double r54 = r37 * r24;
+	const double r55 = r53 - r54;
+	const double r56 = (-0.25) * r55;
+	const double r57 = r52 + r56;
+	const double r58 = (-1.6000000000000001) * r37;
+	const double r59 = (-0.29999999999999999) * r46;
+	const double r60 = r58 - r59;
+	const double r61 = r60 + (-1.6000000000000001);
+	const double r62 = r57 + r61;
+	const double r63 = r49 + r62;
+	const double r64 = r39 * r13;
+	const double r65 = r64 * r9;
+	const double r66 = (-0.47499999999999998) * r65;
+	const double r67 = r2 * r41;
+	const double r68 = r67 * r24;
+	const double r69 = r39 * r5;
+	const double r70 = r69 * r7;
+	const double r71 = r68 - r70;
+	const double r72 = (-0.75) * r71;
+	const double r73 = r66 + r72;
+	const double r74 = 0.20000000000000001 * r65;
+	const double r75 = (-2.5) * r71;
+	const double r76 = r74 + r75;
+	const double r77 = r69 * r24;
+	const double r78 = r67 * r7;
+	const double r79 = r77 + r78;
+	const double r80 = (-0.25) * r79;
+	const double r81 = r76 + r80;
+	const double r82 = (-0.29999999999999999) * r64;
+	const double r83 = (-1.6000000000000001) * r69;
+	const double r84 = r82 - r83;
+	const double r85 = r81 + r84;
+	const double r86 = r73 + r85;
+	const double r87 = r6 * r7;
+	const double r88 = (-0.75) * r87;
+	const double r89 = r14 * r9;
+	const double r90 = (-0.47499999999999998) * r89;
+	const double r91 = r88 - r90;
+	const double r92 = (-2.5) * r87;
+	const double r93 = 0.20000000000000001 * r89;
+	const double r94 = r92 - r93;
+	const double r95 = r6 * r24;
+	const double r96 = (-0.25) * r95;
+	const double r97 = r94 - r96;
+	const double r98 = (-1.6000000000000001) * r6;
+	const double r99 = (-0.29999999999999999) * r14;
+	const double r100 = r98 - r99;
+	const double r101 = r97 + r100;
+	const double r102 = r91 + r101;
+	const double r103 = (-0.75) * r25;
+	const double r104 = (-2.5) * r25;
+	const double r105 = (-0.25) * r15;
+	const double r106 = r104 + r105;
+	const double r107 = r103 + r106;
+	const double r108 = -r107;
+	const double r109 = r46 * r24;
+	const double r110 = (-0.25) * r109;
+	const double r111 = r37 * r9;
+	const double r112 = 0.20000000000000001 * r111;
+	const double r113 = r46 * r7;
+	const double r114 = (-2.5) * r113;
+	const double r115 = r112 + r114;
+	const double r116 = r110 - r115;
+	const double r117 = (-0.29999999999999999) * r37;
+	const double r118 = (-1.6000000000000001) * r46;
+	const double r119 = r117 + r118;
+	const double r120 = r116 - r119;
+	const double r121 = (-0.47499999999999998) * r111;
+	const double r122 = (-0.75) * r113;
+	const double r123 = r121 + r122;
+	const double r124 = r120 - r123;
+	const double r125 = (-0.75) * r55;
+	const double r126 = (-2.5) * r55;
+	const double r127 = (-0.25) * r44;
+	const double r128 = r126 - r127;
+	const double r129 = r125 + r128;
+	const double r130 = r48 - r45;
+	const double r131 = r51 - r50;
+	const double r132 = r54 - r53;
+	const double r133 = (-0.25) * r132;
+	const double r134 = r131 + r133;
+	const double r135 = r59 - r58;
+	const double r136 = r134 + r135;
+	const double r137 = r130 + r136;
+	const double r138 = r69 * r9;
+	const double r139 = (-0.47499999999999998) * r138;
+	const double r140 = r64 * r7;
+	const double r141 = (-0.75) * r140;
+	const double r142 = r139 + r141;
+	const double r143 = 0.20000000000000001 * r138;
+	const double r144 = (-2.5) * r140;
+	const double r145 = r143 + r144;
+	const double r146 = r64 * r24;
+	const double r147 = (-0.25) * r146;
+	const double r148 = r145 - r147;
+	const double r149 = (-0.29999999999999999) * r69;
+	const double r150 = (-1.6000000000000001) * r64;
+	const double r151 = r149 + r150;
+	const double r152 = r148 + r151;
+	const double r153 = r142 + r152;
+	const double r154 = (-0.75) * r79;
+	const double r155 = (-2.5) * r79;
+	const double r156 = r70 - r68;
+	const double r157 = (-0.25) * r156;
+	const double r158 = r155 + r157;
+	const double r159 = r154 + r158;
+	out[0] = r36;
+	out[1] = r63;
+	out[2] = r86;
+	out[3] = 1;
+	out[4] = r102;
+	out[5] = r108;
+	out[6] = r86;
+	out[7] = r124;
+	out[8] = r129;
+	out[9] = r137;
+	out[10] = r153;
+	out[11] = r159;
+}
+
+#endif
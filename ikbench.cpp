@@ -0,0 +1,602 @@
+//
+// ikbench.cpp
+//
+// Headless benchmark of the Jacobian IK on the Gundan left leg. It builds
+// the leg the same way the modeler does and compares the ways Jacobian
+// can obtain its derivatives, including the code generated by ikgen.
+//
+
+#include "gundanik.h"
+#include "gundanleg_gen.h"
+#include "iksolver.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <time.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#define PI 3.14159265
+#define BENCH_CACHE "ikbench.jcache"
+
+static double msSince(clock_t start) {
+	return (clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+//Default slider limits of the left leg, in radians
+static void setLeftLegLimits(Jacobian* leg) {
+	leg->setConstraint(0, -80 / 180.0 * PI, 80 / 180.0 * PI);
+	leg->setConstraint(1, 0, 60 / 180.0 * PI);
+	leg->setConstraint(2, 0, 120 / 180.0 * PI);
+}
+
+//Same budget as the animated solve in Gundan::updateIK
+static int solveLeftLeg(const Jacobian* leg, RealVec& t, const RealVec& r) {
+	JacobSolve s = leg->solve(r, t, 1e-4, 200, 0);
+	t = s.theta;
+	return s.iters;
+}
+
+//Newton steps on the squared error until within the same tolerance
+static int solveNewton(const Jacobian* leg, RealVec& t, const RealVec& r) {
+	RealVec c(4);
+	bool f = false;
+	int generation;
+	for(generation = 1; generation <= 200 && !f; generation++) {
+		t = leg->newtonStep(t, r, f);
+		leg->evalTrans(t, &c[0]);
+		if(RealVec(c - r).modulus() < 1e-4) {
+			f = true;
+		}
+	}
+	return generation - 1;
+}
+
+static void benchMode(const char* name, JacobMode mode, bool newton, const char* cache, int evals, int solves) {
+	Jacobian* leg = createLeftLeg();
+	RealVec t(3), pos(4), r;
+	RealMat jac(3, 4);
+	double prep, evalMs, solveMs, sum = 0;
+	int before, after, i, iters = 0;
+	clock_t start;
+
+	if(mode == JACOB_COMPILED) {
+		leg->setCompiled(leftLegJacobian, LEFTLEGJACOBIAN_HASH);
+	}
+	else {
+		leg->setMode(mode);
+	}
+	leg->useHessian(newton);
+	leg->setCache(cache);
+	setLeftLegLimits(leg);
+	start = clock();
+	leg->preprocess();
+	prep = msSince(start);
+	leg->nodeStats(before, after);
+
+	start = clock();
+	for(i = 0; i < evals; i++) {
+		t[0] = (i % 160 - 80) / 180.0 * PI;
+		t[1] = (i % 60) / 180.0 * PI;
+		t[2] = (i % 120) / 180.0 * PI;
+		leg->evalJacobian(t, pos, jac);
+		sum += jac[0][0] + pos[0];
+	}
+	evalMs = msSince(start);
+
+	start = clock();
+	for(i = 0; i < solves; i++) {
+		t[0] = 0; t[1] = 5 / 180.0 * PI; t[2] = 0;
+		r = leftLegTarget(i % 40, (i * 7) % 40, (i * 13) % 100 - 50);
+		iters += newton ? solveNewton(leg, t, r) : solveLeftLeg(leg, t, r);
+	}
+	solveMs = msSince(start);
+
+	printf("%-10s %8.3f %6d %6d %12.1f %12.2f %8.1f %12g\n", name, prep, before, after,
+		evalMs * 1e6 / evals, solveMs * 1e3 / solves, (double)iters / solves, sum);
+	delete leg;
+}
+
+//Slider drag, one joint moving per evaluation, against every joint
+//moving as in a solver step. Only the position tape keeps the state
+//this measures, the default geometric mode evaluates the links.
+static void benchDrag(int evals) {
+	Jacobian* leg = createLeftLeg();
+	RealVec t(3), pos;
+	double ms[2], sum = 0;
+	int i, j, k;
+	clock_t start;
+
+	leg->setMode(JACOB_SYMBOLIC);
+	leg->preprocess();
+	for(k = 0; k < 2; k++) {
+		t[0] = 0; t[1] = 0.1; t[2] = 0.2;
+		start = clock();
+		for(i = 0; i < evals; i++) {
+			for(j = 0; j < 3; j++) {
+				if(k || j == i % 3) {
+					t[j] += 1e-3;
+				}
+			}
+			pos = leg->evalTrans(t);
+			sum += pos[0];
+		}
+		ms[k] = msSince(start);
+	}
+	printf("\nevalTrans: %.1f ns with one joint moved, %.1f ns with all moved, check %g\n",
+		ms[0] * 1e6 / evals, ms[1] * 1e6 / evals, sum);
+	delete leg;
+}
+
+//Solves every target and records the final joints, position and
+//Jacobian. With own set, builds and preprocesses its own leg first, so
+//the intern table is also hit concurrently.
+static void solveAll(const Jacobian* leg, bool own, int solves, std::vector<double>* res) {
+	Jacobian* mine = NULL;
+	RealVec t(3), pos(4), r;
+	RealMat jac(3, 4);
+	int i, j;
+	if(own) {
+		mine = createLeftLeg();
+		setLeftLegLimits(mine);
+		mine->preprocess();
+		leg = mine;
+	}
+	res->clear();
+	for(i = 0; i < solves; i++) {
+		t[0] = 0; t[1] = 5 / 180.0 * PI; t[2] = 0;
+		r = leftLegTarget(i % 40, (i * 7) % 40, (i * 13) % 100 - 50);
+		solveLeftLeg(leg, t, r);
+		leg->evalJacobian(t, pos, jac);
+		for(j = 0; j < 3; j++) {
+			res->push_back(t[j]);
+		}
+		res->insert(res->end(), &pos[0], &pos[0] + 4);
+		res->insert(res->end(), jac[0], jac[0] + 12);
+	}
+	delete mine;
+}
+
+//One Jacobian shared by many threads must give the single threaded
+//results bit for bit
+static bool checkThreads(int threads, int solves) {
+	Jacobian* leg = createLeftLeg();
+	std::vector<double> ref;
+	std::vector<std::vector<double> > res(threads);
+	std::vector<std::thread> pool;
+	int i, bad = 0;
+	clock_t start;
+
+	setLeftLegLimits(leg);
+	leg->preprocess();
+	solveAll(leg, false, solves, &ref);
+
+	start = clock();
+	for(i = 0; i < threads; i++) {
+		pool.push_back(std::thread(solveAll, leg, i % 4 == 3, solves, &res[i]));
+	}
+	for(i = 0; i < threads; i++) {
+		pool[i].join();
+		bad += res[i] != ref;
+	}
+	printf("\n%d threads x %d solves: %d mismatching, %.1f ms cpu\n", threads, solves, bad, msSince(start));
+	delete leg;
+	return bad == 0;
+}
+
+//Interval rejection over a grid of slider targets, checked against the
+//solver: a rejected target must not be solvable
+static void benchReach(double tol) {
+	Jacobian* leg = createLeftLeg();
+	RealVec t(3), seed, r;
+	double reachMs = 0;
+	int x, y, z, n = 0, rejected = 0, wrong = 0, missed = 0;
+	bool ok, solved;
+	clock_t start;
+
+	setLeftLegLimits(leg);
+	leg->preprocess();
+	for(x = 0; x <= 40; x += 4) {
+		for(y = 0; y <= 40; y += 4) {
+			for(z = -50; z <= 50; z += 10) {
+				r = leftLegTarget(x, y, z);
+				start = clock();
+				ok = leg->reachable(r, tol, &seed);
+				reachMs += msSince(start);
+				t[0] = 0; t[1] = 5 / 180.0 * PI; t[2] = 0;
+				solveLeftLeg(leg, t, r);
+				solved = RealVec(leg->evalTrans(t) - r).modulus() < tol;
+				n++;
+				rejected += !ok;
+				wrong += !ok && solved;
+				missed += ok && !solved;
+			}
+		}
+	}
+	printf("\nreachability over %d targets, tol %g: %d rejected, %.2f us/query\n",
+		n, tol, rejected, reachMs * 1e3 / n);
+	printf("rejected but solvable %d, accepted but unsolved %d\n", wrong, missed);
+	delete leg;
+}
+
+//A tail of alternating hinges, too long to derive symbolically. Both
+//numeric modes must agree, and stepDelta must still reach poses of it.
+static void benchTail(int joints, int evals) {
+	Jacobian* tail = new Jacobian(joints);
+	RealVec t(joints), goal(joints), pos(4), r;
+	RealMat jac[2];
+	double ms[2], diff = 0;
+	int i, j, k, solved = 0, iters = 0;
+	clock_t start;
+
+	for(i = 0; i < joints; i++) {
+		tail->pushRotV(i, i % 2 ? 0.0 : 1.0, 0.0, i % 2 ? 1.0 : 0.0);
+		tail->pushTransC(0, -0.3, 0);
+		tail->setConstraint(i, -PI / 2, PI / 2);
+	}
+	for(k = 0; k < 2; k++) {
+		tail->setMode(k ? JACOB_GEOMETRIC : JACOB_CHAIN);
+		tail->preprocess();
+		jac[k] = RealMat(joints, 4);
+		start = clock();
+		for(i = 0; i < evals; i++) {
+			for(j = 0; j < joints; j++) {
+				t[j] = ((i + j * 7) % 90 - 45) / 180.0 * PI;
+			}
+			tail->evalJacobian(t, pos, jac[k]);
+		}
+		ms[k] = msSince(start);
+	}
+	for(i = 0; i < 3; i++) {
+		for(j = 0; j < joints; j++) {
+			diff = std::max(diff, fabs(jac[0][i][j] - jac[1][i][j]));
+		}
+	}
+
+	for(k = 0; k < 20; k++) {
+		for(j = 0; j < joints; j++) {
+			goal[j] = ((k * 13 + j * 29) % 60 - 30) / 180.0 * PI;
+			t[j] = 0;
+		}
+		r = tail->evalTrans(goal);
+		iters += solveLeftLeg(tail, t, r);
+		tail->evalTrans(t, &pos[0]);
+		if(RealVec(pos - r).modulus() < 1e-4) {
+			solved++;
+		}
+	}
+	printf("\ntail of %d joints: chain %.1f ns, geometric %.1f ns per Jacobian, difference %g\n",
+		joints, ms[0] * 1e6 / evals, ms[1] * 1e6 / evals, diff);
+	printf("%d of 20 poses reached, %.1f iterations\n", solved, iters / 20.0);
+	delete tail;
+}
+
+static double wallMs(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+//Joint limits and the variable count of the four Gundan limbs
+static IKSolver* createLimbs(int threads) {
+	IKSolver* limbs = new IKSolver(threads);
+	int i;
+	limbs->addEffector(createLeftLeg());
+	limbs->addEffector(createRightLeg());
+	limbs->addEffector(createLeftArm());
+	limbs->addEffector(createRightArm());
+	//Every round starts cold
+	limbs->useCache(false);
+	for(i = 0; i < 2; i++) {
+		setLeftLegLimits(limbs->effector(i));
+		limbs->effector(i + 2)->setConstraint(0, 0, 70 / 180.0 * PI);
+		limbs->effector(i + 2)->setConstraint(1, -80 / 180.0 * PI, 80 / 180.0 * PI);
+	}
+	return limbs;
+}
+
+//Poses every limb to the end position of a random pose within its
+//limits, one limb alone and all four at once
+static void benchLimbs(int threads, int rounds) {
+	IKSolver* limbs[2] = {createLimbs(threads), createLimbs(1)};
+	std::vector<RealVec> start(limbs[0]->size());
+	RealVec goal;
+	double ms[2] = {0, 0};
+	int i, j, k, n, converged = 0, mismatch = 0;
+	std::chrono::steady_clock::time_point t;
+
+	for(k = 0; k < rounds; k++) {
+		for(i = 0; i < limbs[0]->size(); i++) {
+			n = limbs[0]->effector(i)->dof();
+			goal = RealVec(n);
+			start[i] = RealVec(n);
+			for(j = 0; j < n; j++) {
+				goal[j] = ((k * 37 + i * 11 + j * 23) % 60) / 180.0 * PI;
+				start[i][j] = 5 / 180.0 * PI;
+			}
+			limbs[0]->effector(i)->preprocess();
+			goal = limbs[0]->effector(i)->evalTrans(goal);
+			limbs[0]->setTarget(i, goal);
+			limbs[1]->setTarget(i, goal);
+			limbs[0]->setTheta(i, start[i]);
+			limbs[1]->setTheta(i, start[i]);
+			limbs[0]->setActive(i, i == 0);
+		}
+		t = std::chrono::steady_clock::now();
+		limbs[0]->solveAll(1e-4, 200, 0, 0);
+		ms[0] += wallMs(t);
+
+		for(i = 0; i < limbs[0]->size(); i++) {
+			limbs[0]->setTheta(i, start[i]);
+			limbs[0]->setActive(i, true);
+		}
+		t = std::chrono::steady_clock::now();
+		limbs[0]->solveAll(1e-4, 200, 0, 0);
+		ms[1] += wallMs(t);
+		limbs[1]->solveAll(1e-4, 200, 0, 0);
+
+		for(i = 0; i < limbs[0]->size(); i++) {
+			converged += limbs[0]->result(i).converged;
+			for(j = 0; j < limbs[0]->theta(i).dim(); j++) {
+				mismatch += limbs[0]->theta(i)[j] != limbs[1]->theta(i)[j];
+			}
+		}
+	}
+	printf("\nlimbs on %d threads: %.1f us for one limb, %.1f us for four\n",
+		threads, ms[0] * 1e3 / rounds, ms[1] * 1e3 / rounds);
+	printf("%d of %d limb poses reached, %d joints differ from a serial solve\n",
+		converged, rounds * limbs[0]->size(), mismatch);
+	delete limbs[0];
+	delete limbs[1];
+}
+
+//Persistent IK while the target is dragged around a loop, each frame
+//solved from the last pose as the modeler does
+static void benchWarm(int frames, int laps) {
+	IKSolver* leg;
+	RealVec t(3);
+	double ms, a;
+	int i, k, c, iters, warm, warmIters, converged;
+	std::chrono::steady_clock::time_point start;
+
+	for(c = 0; c < 2; c++) {
+		leg = new IKSolver(1);
+		leg->addEffector(createLeftLeg());
+		setLeftLegLimits(leg->effector(0));
+		leg->useCache(c == 1);
+		t[0] = 0; t[1] = 5 / 180.0 * PI; t[2] = 0;
+		leg->setTheta(0, t);
+		iters = warm = warmIters = converged = 0;
+		start = std::chrono::steady_clock::now();
+		for(k = 0; k < laps; k++) {
+			for(i = 0; i < frames; i++) {
+				//Later laps pass between the targets of the first
+				a = 2 * PI * (i + k / (double)laps) / frames;
+				leg->setTarget(0, leftLegTarget(8 + 6 * cos(a), 12 + 6 * sin(a), 10 * sin(2 * a)));
+				leg->solveAll(1e-4, 200, 0, 0.05);
+				iters += leg->result(0).iters;
+				if(leg->warmStarted(0)) {
+					warm++;
+					warmIters += leg->result(0).iters;
+				}
+				converged += leg->result(0).converged;
+			}
+		}
+		ms = wallMs(start);
+		printf("%s %6.1f us/frame %6.1f iterations, %d of %d warm taking %.1f, %d converged\n",
+			c ? "cache   " : "no cache", ms * 1e3 / (frames * laps), (double)iters / (frames * laps),
+			warm, frames * laps, warm ? (double)warmIters / warm : 0.0, converged);
+		delete leg;
+	}
+}
+
+//Targets of random joint values with every other joint at a limit,
+//solved with the step clamped to the limits and with useNullSpace,
+//in the interactive schedule and in full steps
+static void benchLimits(const char* name, Jacobian* chain, const RealVec& start, int solves) {
+	RealVec t, goal(chain->dof()), r;
+	JacobSolve s;
+	double ms, lo, hi, centre;
+	int i, k, c, iters, converged, stalled;
+	clock_t clk;
+
+	chain->preprocess();
+	for(c = 0; c < 4; c++) {
+		chain->useNullSpace(c % 2 == 1);
+		srand(11);
+		ms = centre = 0;
+		iters = converged = stalled = 0;
+		for(k = 0; k < solves; k++) {
+			for(i = 0; i < goal.dim(); i++) {
+				chain->getConstraint(i, lo, hi);
+				goal[i] = (i + k) % 2 ? lo + (hi - lo) * rand() / RAND_MAX : rand() % 2 ? hi : lo;
+			}
+			r = chain->evalTrans(goal);
+			clk = clock();
+			s = chain->solve(r, start, 1e-4, 200, 0, c < 2 ? 0 : 1.0);
+			ms += msSince(clk);
+			iters += s.iters;
+			converged += s.converged;
+			stalled += s.stalled;
+			//Mean distance from the middle of the limits, 1 at a limit
+			for(i = 0; i < goal.dim(); i++) {
+				chain->getConstraint(i, lo, hi);
+				centre += fabs(2 * s.theta[i] - lo - hi) / (hi - lo) / goal.dim();
+			}
+		}
+		printf("%-5s %-10s %-9s %7.2f us/solve %6.1f iterations, %d of %d converged, %d stalled, off centre %.2f\n",
+			name, c % 2 ? "null space" : "clamped", c < 2 ? "scheduled" : "full", ms * 1e3 / solves, (double)iters / solves,
+			converged, solves, stalled, centre / solves);
+	}
+	chain->useNullSpace(false);
+}
+
+//Ends of random joint values within the limits, from start by every
+//IKMethod and by Jacobian::solve
+static void benchMethods(const char* name, Jacobian* chain, const RealVec& start, int solves) {
+	IKMethod* method;
+	RealVec goal(chain->dof()), r;
+	JacobSolve s;
+	double ms, err, lo, hi;
+	int i, k, c, iters, converged;
+	clock_t clk;
+
+	chain->preprocess();
+	for(c = 0; c <= IK_METHOD_COUNT; c++) {
+		method = c < IK_METHOD_COUNT ? createIKMethod((IKMethodType)c) : NULL;
+		srand(5);
+		ms = err = 0;
+		iters = converged = 0;
+		for(k = 0; k < solves; k++) {
+			for(i = 0; i < goal.dim(); i++) {
+				chain->getConstraint(i, lo, hi);
+				goal[i] = lo + (hi - lo) * rand() / RAND_MAX;
+			}
+			r = chain->evalTrans(goal);
+			clk = clock();
+			s = method ? method->solve(*chain, r, start, 1e-4, 200, 0) : chain->solve(r, start, 1e-4, 200, 0);
+			ms += msSince(clk);
+			iters += s.iters;
+			converged += s.converged;
+			err += s.error;
+		}
+		printf("%-5s %-7s %8.2f us/solve %6.1f iterations %6.2f us/iteration, %d of %d converged, mean error %.2e\n",
+			name, method ? method->name() : "solve", ms * 1e3 / solves, (double)iters / solves,
+			iters ? ms * 1e3 / iters : 0.0, converged, solves, err / solves);
+		delete method;
+	}
+}
+
+//Angle between two rotations
+static double rotAngle(const RealMat& a, const RealMat& b) {
+	double tr = 0;
+	int i, j;
+	for(i = 0; i < 3; i++) {
+		for(j = 0; j < 3; j++) {
+			tr += a[i][j] * b[i][j];
+		}
+	}
+	return acos(std::max(-1.0, std::min(1.0, (tr - 1) / 2)));
+}
+
+//Poses of random joint values, solved for the position alone and for
+//position and foot rotation together
+static void benchPose(int solves) {
+	Jacobian* leg = createLeftLeg();
+	RealVec t(3), goal(3), pos, r;
+	RealMat rot, got;
+	JacobSolve s;
+	double ms, lo, hi, posErr, rotErr;
+	int i, k, c, iters, converged;
+	clock_t start;
+
+	setLeftLegLimits(leg);
+	leg->preprocess();
+	for(c = 0; c < 2; c++) {
+		srand(7);
+		ms = posErr = rotErr = 0;
+		iters = converged = 0;
+		for(k = 0; k < solves; k++) {
+			for(i = 0; i < 3; i++) {
+				leg->getConstraint(i, lo, hi);
+				goal[i] = lo + (hi - lo) * rand() / RAND_MAX;
+			}
+			leg->evalPose(goal, r, rot);
+			t[0] = 0; t[1] = 5 / 180.0 * PI; t[2] = 0;
+			start = clock();
+			s = c ? leg->solvePose(r, rot, 1.0, t, 1e-4, 200, 0) : leg->solve(r, t, 1e-4, 200, 0);
+			ms += msSince(start);
+			iters += s.iters;
+			converged += s.converged;
+			leg->evalPose(s.theta, pos, got);
+			posErr += RealVec(pos - r).modulus();
+			rotErr += rotAngle(rot, got);
+		}
+		printf("%-8s %6.2f us/solve %6.1f iterations, %d of %d converged, mean error %.2e, %.3f rad\n",
+			c ? "pose" : "position", ms * 1e3 / solves, (double)iters / solves, converged, solves,
+			posErr / solves, rotErr / solves);
+	}
+	delete leg;
+}
+
+int main(int argc, char** argv) {
+	int evals = argc > 1 ? atoi(argv[1]) : 200000;
+	int solves = argc > 2 ? atoi(argv[2]) : 200;
+	Jacobian* leg;
+	RealVec start;
+	FILE* cached;
+	int i;
+
+	printf("%-10s %8s %6s %6s %12s %12s %8s %12s\n", "mode", "prep ms", "nodes", "simp",
+		"ns/jacobian", "us/solve", "iters", "check");
+	benchMode("chain", JACOB_CHAIN, false, NULL, evals, solves);
+	benchMode("geometric", JACOB_GEOMETRIC, false, NULL, evals, solves);
+	benchMode("symbolic", JACOB_SYMBOLIC, false, NULL, evals, solves);
+	benchMode("forward", JACOB_FORWARD, false, NULL, evals, solves);
+	benchMode("reverse", JACOB_REVERSE, false, NULL, evals, solves);
+	benchMode("generated", JACOB_COMPILED, false, NULL, evals, solves);
+	benchMode("newton", JACOB_SYMBOLIC, true, NULL, evals, solves);
+
+	//Startup with the partials already on disk. Only symbolic modes
+	//derive, and so write the cache.
+	remove(BENCH_CACHE);
+	leg = createLeftLeg();
+	leg->setMode(JACOB_SYMBOLIC);
+	leg->setCache(BENCH_CACHE);
+	leg->preprocess();
+	delete leg;
+	if(!(cached = fopen(BENCH_CACHE, "rb"))) {
+		printf("%s was not written, the cached row derives from scratch\n", BENCH_CACHE);
+	}
+	else {
+		fclose(cached);
+	}
+	benchMode("cached", JACOB_SYMBOLIC, false, BENCH_CACHE, evals, solves);
+	remove(BENCH_CACHE);
+
+	benchDrag(evals);
+	benchReach(0.05);
+	benchTail(40, evals / 10);
+	benchLimbs(4, solves);
+	printf("\ndragged target, 3 laps of 60 frames\n");
+	benchWarm(60, 3);
+	printf("\nfoot poses of %d random joint values\n", solves);
+	benchPose(solves);
+
+	printf("\ntargets with joints at their limits\n");
+	leg = createLeftLeg();
+	setLeftLegLimits(leg);
+	start = RealVec(3);
+	start[0] = 0; start[1] = 5 / 180.0 * PI; start[2] = 0;
+	benchLimits("leg", leg, start, solves);
+	delete leg;
+	leg = new Jacobian(12);
+	start = RealVec(12);
+	for(i = 0; i < 12; i++) {
+		leg->pushRotV(i, i % 2 ? 0.0 : 1.0, 0.0, i % 2 ? 1.0 : 0.0);
+		leg->pushTransC(0, -0.3, 0);
+		leg->setConstraint(i, -PI / 4, PI / 4);
+		start[i] = 0;
+	}
+	benchLimits("tail", leg, start, solves);
+	delete leg;
+
+	printf("\nsolvers on ends of random joint values\n");
+	leg = createLeftLeg();
+	setLeftLegLimits(leg);
+	start = RealVec(3);
+	start[0] = 0; start[1] = 5 / 180.0 * PI; start[2] = 0;
+	benchMethods("leg", leg, start, solves);
+	delete leg;
+	leg = new Jacobian(40);
+	start = RealVec(40);
+	for(i = 0; i < 40; i++) {
+		leg->pushRotV(i, i % 2 ? 0.0 : 1.0, 0.0, i % 2 ? 1.0 : 0.0);
+		leg->pushTransC(0, -0.3, 0);
+		leg->setConstraint(i, -PI / 4, PI / 4);
+		start[i] = 0;
+	}
+	benchMethods("tail", leg, start, solves);
+	delete leg;
+	return checkThreads(8, solves) ? 0 : 1;
+}
@@ -0,0 +1,20 @@
+//
+// ikgen.cpp
+//
+// Regenerates gundanleg_gen.h, the straight-line position and Jacobian
+// of the Gundan left leg. Run by the ikgen project after every build.
+//
+
+#include "gundanik.h"
+#include <stdio.h>
+
+int main(int argc, char** argv) {
+	const char* path = argc > 1 ? argv[1] : "gundanleg_gen.h";
+	Jacobian* leg = createLeftLeg();
+	if(!leg->writeCpp(path, "leftLegJacobian")) {
+		fprintf(stderr, "ikgen: cannot write %s\n", path);
+		return 1;
+	}
+	delete leg;
+	return 0;
+}
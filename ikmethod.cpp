@@ -0,0 +1,317 @@
+#include "ikmethod.h"
+#include <math.h>
+#include <assert.h>
+#include <algorithm>
+#include <chrono>
+
+#define CALC_EPS (1e-6)
+//Regularisation of the pseudo-inverse relative to the scale of J J^T,
+//only enough to keep it defined at a singularity
+#define IK_PINV_EPS (1e-12)
+
+IKMethod::~IKMethod() {}
+
+JacobSolve IKMethod::solve(const Jacobian& chain, const RealVec& target, const RealVec& initialTheta, double tolerance, int maxIters, double timeBudget) const {
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point start = Clock::now();
+	JacobSolve ret;
+	double cur[JACOB_MAX_DOF], next[JACOB_MAX_DOF], moved;
+	const int n = chain.dof();
+	int i;
+
+	assert(n <= JACOB_MAX_DOF);
+	ret.iters = 0;
+	ret.converged = ret.stalled = ret.timedOut = false;
+	for(i = 0; i < n; i++) {
+		cur[i] = initialTheta[i];
+	}
+	ret.error = sqrt(chain.posError(cur, &target[0]));
+
+	while(ret.error >= tolerance) {
+		if(ret.iters >= maxIters) {
+			break;
+		}
+		if(timeBudget > 0 && std::chrono::duration<double, std::milli>(Clock::now() - start).count() >= timeBudget) {
+			ret.timedOut = true;
+			break;
+		}
+		ret.iters++;
+		step(chain, cur, &target[0], next);
+		moved = 0;
+		for(i = 0; i < n; i++) {
+			moved = std::max(moved, fabs(next[i] - cur[i]));
+			cur[i] = next[i];
+		}
+		ret.error = sqrt(chain.posError(cur, &target[0]));
+		if(moved <= CALC_EPS && ret.error >= tolerance) {
+			ret.stalled = true;
+			break;
+		}
+	}
+	ret.converged = ret.error < tolerance;
+
+	ret.theta = RealVec(n);
+	for(i = 0; i < n; i++) {
+		ret.theta[i] = cur[i];
+	}
+	ret.ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	return ret;
+}
+
+//value within the constraints of joint var
+static double limit(const Jacobian& chain, int var, double value) {
+	double lo, hi;
+	chain.getConstraint(var, lo, hi);
+	return std::min(hi, std::max(lo, value));
+}
+
+//Rotation by ang about the unit axis a
+static void rotation(const double* a, double ang, double r[3][3]) {
+	const double s = sin(ang), c = cos(ang), t = 1 - c;
+	r[0][0] = t * a[0] * a[0] + c;
+	r[0][1] = t * a[0] * a[1] - s * a[2];
+	r[0][2] = t * a[0] * a[2] + s * a[1];
+	r[1][0] = t * a[1] * a[0] + s * a[2];
+	r[1][1] = t * a[1] * a[1] + c;
+	r[1][2] = t * a[1] * a[2] - s * a[0];
+	r[2][0] = t * a[2] * a[0] - s * a[1];
+	r[2][1] = t * a[2] * a[1] + s * a[0];
+	r[2][2] = t * a[2] * a[2] + c;
+}
+
+//x = r (x - o) + o
+static void turnPoint(const double r[3][3], const double* o, double* x) {
+	double d[3];
+	int i;
+	for(i = 0; i < 3; i++) {
+		d[i] = x[i] - o[i];
+	}
+	for(i = 0; i < 3; i++) {
+		x[i] = r[i][0] * d[0] + r[i][1] * d[1] + r[i][2] * d[2] + o[i];
+	}
+}
+
+//Adds the sine and cosine terms of turning p towards goal about the
+//unit axis a through o: both taken into the plane normal to a, the
+//cross and dot products of the two. atan2(s, c) is the angle that
+//brings p nearest to goal, or with several points their sum weighted
+//by their distances from the axis.
+static void turnTerms(const double* a, const double* o, const double* p, const double* goal, double& s, double& c) {
+	double u[3], v[3], du = 0, dv = 0;
+	int i;
+	for(i = 0; i < 3; i++) {
+		u[i] = p[i] - o[i];
+		v[i] = goal[i] - o[i];
+		du += u[i] * a[i];
+		dv += v[i] * a[i];
+	}
+	for(i = 0; i < 3; i++) {
+		u[i] -= du * a[i];
+		v[i] -= dv * a[i];
+	}
+	s += a[0] * (u[1] * v[2] - u[2] * v[1]) + a[1] * (u[2] * v[0] - u[0] * v[2]) + a[2] * (u[0] * v[1] - u[1] * v[0]);
+	c += u[0] * v[0] + u[1] * v[1] + u[2] * v[2];
+}
+
+//A point on the axis, or a goal there, leaves both terms at zero
+static double bestTurn(double s, double c) {
+	return fabs(s) + fabs(c) <= CALC_EPS * CALC_EPS ? 0 : atan2(s, c);
+}
+
+const char* PinvMethod::name() const {
+	return "pinv";
+}
+
+void PinvMethod::step(const Jacobian& chain, const double* theta, const double* target, double* next) const {
+	double jac[3][JACOB_MAX_DOF], pos[4], e[3], a[3][3], y[3], m[3][3], det, scale = 0;
+	const int n = chain.dof();
+	int i, j, k;
+
+	chain.evalJacobian(theta, pos, jac);
+	for(i = 0; i < 3; i++) {
+		e[i] = target[i] - pos[i];
+		for(j = 0; j < 3; j++) {
+			a[i][j] = 0;
+			for(k = 0; k < n; k++) {
+				a[i][j] += jac[i][k] * jac[j][k];
+			}
+		}
+		scale = std::max(scale, a[i][i]);
+	}
+	for(i = 0; i < 3; i++) {
+		a[i][i] += IK_PINV_EPS * scale + IK_PINV_EPS;
+	}
+	//Cramer's rule on the symmetric 3 x 3
+	m[0][0] = a[1][1] * a[2][2] - a[1][2] * a[2][1];
+	m[0][1] = a[0][2] * a[2][1] - a[0][1] * a[2][2];
+	m[0][2] = a[0][1] * a[1][2] - a[0][2] * a[1][1];
+	m[1][1] = a[0][0] * a[2][2] - a[0][2] * a[2][0];
+	m[1][2] = a[0][2] * a[1][0] - a[0][0] * a[1][2];
+	m[2][2] = a[0][0] * a[1][1] - a[0][1] * a[1][0];
+	m[1][0] = m[0][1];
+	m[2][0] = m[0][2];
+	m[2][1] = m[1][2];
+	det = a[0][0] * m[0][0] + a[0][1] * m[1][0] + a[0][2] * m[2][0];
+	for(i = 0; i < 3; i++) {
+		y[i] = (m[i][0] * e[0] + m[i][1] * e[1] + m[i][2] * e[2]) / det;
+	}
+	for(k = 0; k < n; k++) {
+		next[k] = limit(chain, k, theta[k] + jac[0][k] * y[0] + jac[1][k] * y[1] + jac[2][k] * y[2]);
+	}
+}
+
+const char* DLSMethod::name() const {
+	return "dls";
+}
+
+void DLSMethod::step(const Jacobian& chain, const double* theta, const double* target, double* next) const {
+	bool finished;
+	chain.stepDelta(theta, target, 1.0, next, finished);
+}
+
+const char* CCDMethod::name() const {
+	return "ccd";
+}
+
+//From the end inwards only the end moves, so one pass of frames serves
+//the whole sweep
+void CCDMethod::step(const Jacobian& chain, const double* theta, const double* target, double* next) const {
+	double axis[CHAIN_MAX_LINKS][3], org[CHAIN_MAX_LINKS][3], end[3], r[3][3], ang, v, s, c;
+	int var[CHAIN_MAX_LINKS];
+	int k, m;
+
+	for(k = 0; k < chain.dof(); k++) {
+		next[k] = theta[k];
+	}
+	m = chain.jointFrames(theta, end, axis, org, var);
+	for(k = m - 1; k >= 0; k--) {
+		s = c = 0;
+		turnTerms(axis[k], org[k], end, target, s, c);
+		ang = bestTurn(s, c);
+		v = limit(chain, var[k], next[var[k]] + ang);
+		ang = v - next[var[k]];
+		next[var[k]] = v;
+		rotation(axis[k], ang, r);
+		turnPoint(r, org[k], end);
+	}
+}
+
+const char* FABRIKMethod::name() const {
+	return "fabrik";
+}
+
+void FABRIKMethod::step(const Jacobian& chain, const double* theta, const double* target, double* next) const {
+	double axis[CHAIN_MAX_LINKS][3], org[CHAIN_MAX_LINKS + 1][3], q[CHAIN_MAX_LINKS + 1][3];
+	double len[CHAIN_MAX_LINKS], rot[3][3], r[3][3], t[3][3], move[3], a[3], o[3], p[3], end[3], d, ang, v, s, c;
+	int var[CHAIN_MAX_LINKS];
+	int i, j, k, m, after;
+
+	for(k = 0; k < chain.dof(); k++) {
+		next[k] = theta[k];
+	}
+	//Points 0 to m - 1 are the joint origins, m the end
+	m = chain.jointFrames(theta, end, axis, org, var);
+	for(i = 0; i < 3; i++) {
+		org[m][i] = end[i];
+	}
+	for(k = 0; k < m; k++) {
+		len[k] = 0;
+		for(i = 0; i < 3; i++) {
+			len[k] += (org[k + 1][i] - org[k][i]) * (org[k + 1][i] - org[k][i]);
+		}
+		len[k] = sqrt(len[k]);
+	}
+
+	//Backward from the target, then forward from the fixed base
+	for(i = 0; i < 3; i++) {
+		q[m][i] = target[i];
+	}
+	for(k = m - 1; k >= 0; k--) {
+		d = 0;
+		for(i = 0; i < 3; i++) {
+			d += (org[k][i] - q[k + 1][i]) * (org[k][i] - q[k + 1][i]);
+		}
+		d = sqrt(d);
+		for(i = 0; i < 3; i++) {
+			q[k][i] = d > CALC_EPS ? q[k + 1][i] + (org[k][i] - q[k + 1][i]) * len[k] / d : q[k + 1][i];
+		}
+	}
+	for(i = 0; i < 3; i++) {
+		q[0][i] = org[0][i];
+	}
+	for(k = 0; k < m; k++) {
+		d = 0;
+		for(i = 0; i < 3; i++) {
+			d += (q[k + 1][i] - q[k][i]) * (q[k + 1][i] - q[k][i]);
+		}
+		d = sqrt(d);
+		for(i = 0; i < 3; i++) {
+			q[k + 1][i] = d > CALC_EPS ? q[k][i] + (q[k + 1][i] - q[k][i]) * len[k] / d : q[k][i];
+		}
+	}
+
+	//Each turn moves everything after the joint, carried as x -> rot x
+	//+ move applied to the frames at theta
+	for(i = 0; i < 3; i++) {
+		move[i] = 0;
+		for(j = 0; j < 3; j++) {
+			rot[i][j] = i == j;
+		}
+	}
+	for(k = 0; k < m; k++) {
+		//Joints sharing an origin all turn the next point apart from it
+		after = k + 1;
+		while(after < m && len[after - 1] <= CALC_EPS) {
+			after++;
+		}
+		for(i = 0; i < 3; i++) {
+			a[i] = rot[i][0] * axis[k][0] + rot[i][1] * axis[k][1] + rot[i][2] * axis[k][2];
+			o[i] = rot[i][0] * org[k][0] + rot[i][1] * org[k][1] + rot[i][2] * org[k][2] + move[i];
+			p[i] = rot[i][0] * org[after][0] + rot[i][1] * org[after][1] + rot[i][2] * org[after][2] + move[i];
+			end[i] = rot[i][0] * org[m][0] + rot[i][1] * org[m][1] + rot[i][2] * org[m][2] + move[i];
+		}
+		s = c = 0;
+		turnTerms(a, o, p, q[after], s, c);
+		if(after < m) {
+			turnTerms(a, o, end, q[m], s, c);
+		}
+		ang = bestTurn(s, c);
+		v = limit(chain, var[k], next[var[k]] + ang);
+		ang = v - next[var[k]];
+		next[var[k]] = v;
+		rotation(a, ang, r);
+		for(i = 0; i < 3; i++) {
+			for(j = 0; j < 3; j++) {
+				t[i][j] = r[i][0] * rot[0][j] + r[i][1] * rot[1][j] + r[i][2] * rot[2][j];
+			}
+		}
+		for(i = 0; i < 3; i++) {
+			for(j = 0; j < 3; j++) {
+				rot[i][j] = t[i][j];
+			}
+		}
+		//move turns about o as well
+		for(i = 0; i < 3; i++) {
+			p[i] = move[i];
+		}
+		turnPoint(r, o, p);
+		for(i = 0; i < 3; i++) {
+			move[i] = p[i];
+		}
+	}
+}
+
+IKMethod* createIKMethod(IKMethodType type) {
+	switch(type) {
+	case IK_METHOD_PINV:
+		return new PinvMethod();
+	case IK_METHOD_DLS:
+		return new DLSMethod();
+	case IK_METHOD_CCD:
+		return new CCDMethod();
+	case IK_METHOD_FABRIK:
+		return new FABRIKMethod();
+	default:
+		return NULL;
+	}
+}
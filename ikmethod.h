@@ -0,0 +1,66 @@
+#ifndef __IKMETHOD_HEADER__
+#define __IKMETHOD_HEADER__
+
+#include "jacobian.h"
+
+enum IKMethodType {
+	//Undamped pseudo-inverse J^T (J J^T)^-1 e, clamped to the limits
+	IK_METHOD_PINV = 0,
+	//Jacobian::stepDelta in full steps
+	IK_METHOD_DLS,
+	//Cyclic coordinate descent, one sweep from the end to the base
+	IK_METHOD_CCD,
+	//Forward and backward reaching on the joint positions
+	IK_METHOD_FABRIK,
+	IK_METHOD_COUNT
+};
+
+//One way of taking a Jacobian's joints to a target. Methods keep no
+//state, so one may serve any number of chains and threads at once.
+class IKMethod {
+public:
+	virtual ~IKMethod();
+
+	virtual const char* name() const=0;
+	//One iteration from theta towards target, next receives DOF joint
+	//values within the constraints
+	virtual void step(const Jacobian& chain, const double* theta, const double* target, double* next) const=0;
+
+	//Repeats step with the ends of Jacobian::solve. Stalled when an
+	//iteration no longer moves any joint.
+	JacobSolve solve(const Jacobian& chain, const RealVec& target, const RealVec& initialTheta, double tolerance, int maxIters, double timeBudget) const;
+};
+
+class PinvMethod: public IKMethod {
+public:
+	virtual const char* name() const;
+	virtual void step(const Jacobian& chain, const double* theta, const double* target, double* next) const;
+};
+
+class DLSMethod: public IKMethod {
+public:
+	virtual const char* name() const;
+	virtual void step(const Jacobian& chain, const double* theta, const double* target, double* next) const;
+};
+
+//CCD and FABRIK need the pushed links, not setTrans
+class CCDMethod: public IKMethod {
+public:
+	virtual const char* name() const;
+	virtual void step(const Jacobian& chain, const double* theta, const double* target, double* next) const;
+};
+
+//The points reached for are the joint origins and the end. Hinges
+//cannot follow them freely, so from the base out each joint turns the
+//next point of the chain, and the end, as close as its axis lets it to
+//where the passes put them. Without the end term offsets along the
+//hinges leave fixed points short of the target.
+class FABRIKMethod: public IKMethod {
+public:
+	virtual const char* name() const;
+	virtual void step(const Jacobian& chain, const double* theta, const double* target, double* next) const;
+};
+
+IKMethod* createIKMethod(IKMethodType type);
+
+#endif
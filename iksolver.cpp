@@ -0,0 +1,290 @@
+#include "iksolver.h"
+#include <math.h>
+
+PoseCache::PoseCache() {}
+
+void PoseCache::clear() {
+	cells.clear();
+}
+
+int PoseCache::size() const {
+	return (int)cells.size();
+}
+
+//21 bits per cell coordinate
+unsigned long long PoseCache::key(int x, int y, int z) {
+	const unsigned long long m = (1 << 21) - 1;
+	return ((unsigned long long)x & m) | ((unsigned long long)y & m) << 21 | ((unsigned long long)z & m) << 42;
+}
+
+void PoseCache::store(const RealVec& target, const RealVec& theta, double error) {
+	Entry e;
+	int i;
+	if((int)cells.size() >= POSE_CACHE_MAX) {
+		cells.clear();
+	}
+	for(i = 0; i < 3; i++) {
+		e.pos[i] = target[i];
+	}
+	e.theta = theta;
+	e.error = error;
+	cells[key((int)floor(target[0] / POSE_CACHE_CELL), (int)floor(target[1] / POSE_CACHE_CELL),
+		(int)floor(target[2] / POSE_CACHE_CELL))] = e;
+}
+
+bool PoseCache::nearest(const RealVec& target, RealVec& theta, double& dist) const {
+	CellMap::const_iterator it;
+	const Entry* best = NULL;
+	double d, bestd = 0;
+	int c[3], i, j, k, l;
+	for(i = 0; i < 3; i++) {
+		c[i] = (int)floor(target[i] / POSE_CACHE_CELL);
+	}
+	for(i = -1; i <= 1; i++) {
+		for(j = -1; j <= 1; j++) {
+			for(k = -1; k <= 1; k++) {
+				it = cells.find(key(c[0] + i, c[1] + j, c[2] + k));
+				if(it == cells.end()) {
+					continue;
+				}
+				//Residuals count as distance, they are part of the way
+				d = 0;
+				for(l = 0; l < 3; l++) {
+					d += (it->second.pos[l] - target[l]) * (it->second.pos[l] - target[l]);
+				}
+				d = sqrt(d) + it->second.error;
+				if(!best || d < bestd) {
+					best = &it->second;
+					bestd = d;
+				}
+			}
+		}
+	}
+	if(!best) {
+		return false;
+	}
+	theta = best->theta;
+	dist = 0;
+	for(l = 0; l < 3; l++) {
+		dist += (best->pos[l] - target[l]) * (best->pos[l] - target[l]);
+	}
+	dist = sqrt(dist);
+	return true;
+}
+
+IKSolver::IKSolver(int threads): next(0), pending(0), generation(0), quit(false),
+tol(0), budget(0), reach_tol(0), max_iters(0), cache(true), method(NULL) {
+	int i;
+	if(threads <= 0) {
+		threads = (int)std::thread::hardware_concurrency();
+	}
+	for(i = 1; i < threads; i++) {
+		workers.push_back(std::thread(&IKSolver::work, this));
+	}
+}
+
+IKSolver::~IKSolver() {
+	int i;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		quit = true;
+	}
+	wake.notify_all();
+	for(i = 0; i < (int)workers.size(); i++) {
+		workers[i].join();
+	}
+	for(i = 0; i < (int)effectors.size(); i++) {
+		delete effectors[i].jacob;
+	}
+	delete method;
+}
+
+int IKSolver::addEffector(Jacobian* chain) {
+	Effector e;
+	e.jacob = chain;
+	e.active = true;
+	e.rot_weight = 0;
+	e.skipped = e.warm = false;
+	e.result.error = 0;
+	e.result.iters = 0;
+	e.result.ms = 0;
+	e.result.converged = e.result.stalled = e.result.timedOut = false;
+	effectors.push_back(e);
+	return (int)effectors.size() - 1;
+}
+
+int IKSolver::size() const {
+	return (int)effectors.size();
+}
+
+Jacobian* IKSolver::effector(int idx) {
+	return effectors[idx].jacob;
+}
+
+void IKSolver::setTarget(int idx, const RealVec& target) {
+	effectors[idx].target = target;
+}
+
+void IKSolver::setTheta(int idx, const RealVec& theta) {
+	effectors[idx].theta = theta;
+}
+
+void IKSolver::setOrientation(int idx, const RealMat& rot, double weight) {
+	effectors[idx].rot = rot;
+	effectors[idx].rot_weight = weight;
+}
+
+void IKSolver::setActive(int idx, bool active) {
+	effectors[idx].active = active;
+}
+
+void IKSolver::useCache(bool on) {
+	cache = on;
+}
+
+void IKSolver::clearCache(int idx) {
+	effectors[idx].cache.clear();
+}
+
+void IKSolver::setMethod(IKMethod* m) {
+	if(m != method) {
+		delete method;
+		method = m;
+	}
+}
+
+const IKMethod* IKSolver::getMethod() const {
+	return method;
+}
+
+void IKSolver::solveAll(double tolerance, int maxIters, double timeBudget, double reachTol) {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		tol = tolerance;
+		max_iters = maxIters;
+		budget = timeBudget;
+		reach_tol = reachTol;
+		next = 0;
+		pending = (int)effectors.size();
+		generation++;
+	}
+	wake.notify_all();
+	runJobs();
+
+	std::unique_lock<std::mutex> guard(lock);
+	while(pending > 0) {
+		done.wait(guard);
+	}
+}
+
+const JacobSolve& IKSolver::result(int idx) const {
+	return effectors[idx].result;
+}
+
+const RealVec& IKSolver::theta(int idx) const {
+	return effectors[idx].theta;
+}
+
+bool IKSolver::skipped(int idx) const {
+	return effectors[idx].skipped;
+}
+
+bool IKSolver::warmStarted(int idx) const {
+	return effectors[idx].warm;
+}
+
+//Worker threads sleep until solveAll bumps the generation
+void IKSolver::work() {
+	unsigned int seen = 0;
+	for(;;) {
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			while(!quit && seen == generation) {
+				wake.wait(guard);
+			}
+			if(quit) {
+				return;
+			}
+			seen = generation;
+		}
+		runJobs();
+	}
+}
+
+//Takes effectors until none are left, on the caller and every worker
+void IKSolver::runJobs() {
+	int idx;
+	for(;;) {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if(next >= (int)effectors.size()) {
+				return;
+			}
+			idx = next++;
+		}
+		solveOne(effectors[idx]);
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if(--pending == 0) {
+				done.notify_all();
+			}
+		}
+	}
+}
+
+//Each effector has its own Jacobian, so nothing here is shared
+void IKSolver::solveOne(Effector& e) {
+	RealVec seed, warm;
+	double a, b, dist = 0, lo, hi;
+	bool hit = false, pose;
+	int i;
+	e.skipped = e.warm = false;
+	if(!e.active) {
+		return;
+	}
+	e.jacob->preprocess();
+	//The cache only knows positions
+	pose = e.rot_weight > 0;
+
+	//Cached poses from before a change of the limits may violate them
+	if(cache && !pose && e.cache.nearest(e.target, warm, dist)) {
+		hit = true;
+		for(i = 0; i < warm.dim(); i++) {
+			e.jacob->getConstraint(i, lo, hi);
+			hit = hit && warm[i] >= lo && warm[i] <= hi;
+		}
+	}
+	b = RealVec(e.jacob->evalTrans(e.theta) - e.target).modulus();
+
+	//A solution that close already shows the target is in reach
+	if(reach_tol > 0 && !(hit && dist <= reach_tol)) {
+		if(!e.jacob->reachable(e.target, reach_tol, &seed)) {
+			e.skipped = true;
+			return;
+		}
+		a = RealVec(e.jacob->evalTrans(seed) - e.target).modulus();
+		if(a < b) {
+			e.theta = seed;
+			b = a;
+		}
+	}
+	//Near a solution full steps converge at once, the short steps of
+	//the default schedule are for starts far from the target
+	if(hit && RealVec(e.jacob->evalTrans(warm) - e.target).modulus() < b) {
+		e.theta = warm;
+		e.warm = true;
+	}
+	if(pose) {
+		e.result = e.jacob->solvePose(e.target, e.rot, e.rot_weight, e.theta, tol, max_iters, budget);
+	}
+	else if(method) {
+		e.result = method->solve(*e.jacob, e.target, e.theta, tol, max_iters, budget);
+	}
+	else {
+		e.result = e.jacob->solve(e.target, e.theta, tol, max_iters, budget, e.warm ? 1.0 : 0);
+	}
+	e.theta = e.result.theta;
+	if(cache && !pose && e.result.converged) {
+		e.cache.store(e.target, e.theta, e.result.error);
+	}
+}
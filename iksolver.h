@@ -0,0 +1,124 @@
+#ifndef __IKSOLVER_HEADER__
+#define __IKSOLVER_HEADER__
+
+#include "jacobian.h"
+#include "ikmethod.h"
+#include <vector>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//Edge of the target cells PoseCache keys solutions by
+#define POSE_CACHE_CELL (0.05)
+//Cells kept before the cache starts over
+#define POSE_CACHE_MAX (65536)
+
+//Converged joint vectors of one chain, at most one per target cell
+class PoseCache {
+public:
+	PoseCache();
+
+	void clear();
+	int size() const;
+	//Keeps theta, which reached target within error, in target's cell
+	void store(const RealVec& target, const RealVec& theta, double error);
+	//Solution whose target is nearest to target, searching its cell
+	//and the 26 around it. dist receives the distance of the targets.
+	bool nearest(const RealVec& target, RealVec& theta, double& dist) const;
+
+private:
+	struct Entry {
+		double pos[3];
+		RealVec theta;
+		double error;
+	};
+	typedef std::unordered_map<unsigned long long, Entry> CellMap;
+
+	static unsigned long long key(int x, int y, int z);
+
+	CellMap cells;
+};
+
+//Several end effectors, each a Jacobian with its own target, joint
+//values and constraints. Effectors are independent chains, so solveAll
+//hands them to a pool of threads and takes about as long as the
+//slowest one.
+class IKSolver {
+public:
+	//threads <= 0 uses one per hardware thread. The calling thread
+	//counts as one of them.
+	IKSolver(int threads);
+	~IKSolver();
+
+	//Takes ownership of chain, returns the effector index
+	int addEffector(Jacobian* chain);
+	int size() const;
+	//Constraints and mode are set on the Jacobian directly, but not
+	//while solveAll runs
+	Jacobian* effector(int idx);
+
+	void setTarget(int idx, const RealVec& target);
+	void setTheta(int idx, const RealVec& theta);
+	//End rotation goal, solved with Jacobian::solvePose. weight trades
+	//radians against distance, 0 goes back to position only. Poses
+	//solved with a rotation are not cached.
+	void setOrientation(int idx, const RealMat& rot, double weight);
+	//Effectors that are not active keep their joint values
+	void setActive(int idx, bool active);
+	//Converged solutions are kept per effector, and a later target near
+	//one starts from it with full steps. On by default.
+	void useCache(bool on);
+	void clearCache(int idx);
+	//Takes ownership of method and solves positions with it instead of
+	//Jacobian::solve. NULL goes back to Jacobian::solve.
+	void setMethod(IKMethod* m);
+	//NULL while Jacobian::solve is used
+	const IKMethod* getMethod() const;
+
+	//Jacobian::solve for every active effector, from its joint values.
+	//With reachTol > 0 targets Jacobian::reachable rules out are
+	//skipped, and the others start from its seed when that is closer.
+	void solveAll(double tolerance, int maxIters, double timeBudget, double reachTol);
+
+	//Of the last solveAll
+	const JacobSolve& result(int idx) const;
+	const RealVec& theta(int idx) const;
+	bool skipped(int idx) const;
+	//Started from a cached solution
+	bool warmStarted(int idx) const;
+
+private:
+	struct Effector {
+		Jacobian* jacob;
+		RealVec target, theta;
+		RealMat rot;
+		double rot_weight;
+		bool active, skipped, warm;
+		JacobSolve result;
+		PoseCache cache;
+	};
+
+	void work();
+	void runJobs();
+	void solveOne(Effector& e);
+
+	std::vector<Effector> effectors;
+	std::vector<std::thread> workers;
+
+	//Guards the job counters below
+	std::mutex lock;
+	std::condition_variable wake, done;
+	//Next effector to hand out, and effectors not finished yet
+	int next, pending;
+	//Bumped by every solveAll, wakes the workers
+	unsigned int generation;
+	bool quit;
+
+	double tol, budget, reach_tol;
+	int max_iters;
+	bool cache;
+	IKMethod* method;
+};
+
+#endif
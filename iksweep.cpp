@@ -0,0 +1,226 @@
+//
+// iksweep.cpp
+//
+// Headless sweep of the left leg IK over its whole slider workspace. The
+// leg is set up as Gundan::initJacobian and beginIK do, then every target
+// of a grid over IKX/IKY/IKZ is solved from the default pose on a pool of
+// threads sharing the one Jacobian.
+//
+// usage: iksweep [grid points per axis] [threads] [tolerance] [method]
+//
+// method is jacobian (Jacobian::solve, the default), pinv, dls, ccd or
+// fabrik, or all to sweep once with each and compare them.
+//
+
+#include "gundanik.h"
+#include "ikmethod.h"
+#include "gundanleg_gen.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <string.h>
+
+#define PI 3.14159265
+//Same as gundan.cpp
+#define IK_REACH_TOL 0.05
+#define IK_MAX_ITERS 200
+//Iterations per histogram bucket
+#define SWEEP_BUCKET 10
+
+struct SweepResult {
+	bool rejected;
+	JacobSolve solve;
+};
+
+//Totals over the targets in reach
+struct SweepStats {
+	int rejected, converged, stalled, iters;
+	double wall;
+	std::vector<double> ms;
+};
+
+//Default limit sliders
+static void setLeftLegLimits(Jacobian* leg) {
+	leg->setConstraint(0, -80 / 180.0 * PI, 80 / 180.0 * PI);
+	leg->setConstraint(1, 0, 60 / 180.0 * PI);
+	leg->setConstraint(2, 0, 120 / 180.0 * PI);
+}
+
+//Slider value of grid point i out of n over [lo, hi]
+static double gridValue(int i, int n, double lo, double hi) {
+	return n > 1 ? lo + (hi - lo) * i / (n - 1) : (lo + hi) / 2;
+}
+
+//beginIK for one target: reachability, seed, then the solve with method,
+//or Jacobian::solve without one. Only const members of leg and method,
+//so any number of threads can share them.
+static void sweepOne(const Jacobian* leg, const IKMethod* method, int idx, int n, double tol, SweepResult& res) {
+	RealVec t(3), seed, r;
+	double a[4], b[4], da = 0, db = 0;
+	int i;
+
+	r = leftLegTarget(gridValue(idx % n, n, 0, 40), gridValue(idx / n % n, n, 0, 40),
+		gridValue(idx / (n * n), n, -50, 50));
+	res.rejected = !leg->reachable(r, IK_REACH_TOL, &seed);
+	if(res.rejected) {
+		return;
+	}
+	//Slider defaults
+	t[0] = 0; t[1] = 5 / 180.0 * PI; t[2] = 0;
+	leg->evalTrans(seed, a);
+	leg->evalTrans(t, b);
+	for(i = 0; i < 3; i++) {
+		da += (a[i] - r[i]) * (a[i] - r[i]);
+		db += (b[i] - r[i]) * (b[i] - r[i]);
+	}
+	if(method) {
+		res.solve = method->solve(*leg, r, da < db ? seed : t, tol, IK_MAX_ITERS, 0);
+	}
+	else {
+		res.solve = leg->solve(r, da < db ? seed : t, tol, IK_MAX_ITERS, 0);
+	}
+}
+
+static void sweepWorker(const Jacobian* leg, const IKMethod* method, int n, double tol, std::atomic<int>* next, std::vector<SweepResult>* res) {
+	int idx;
+	while((idx = (*next)++) < (int)res->size()) {
+		sweepOne(leg, method, idx, n, tol, (*res)[idx]);
+	}
+}
+
+static double percentile(const std::vector<double>& sorted, double p) {
+	if(sorted.empty()) {
+		return 0;
+	}
+	return sorted[std::min((int)sorted.size() - 1, (int)(p * sorted.size()))];
+}
+
+//Solves every target of the grid with method, res receives one result
+//per target and hist their iteration counts
+static void sweep(const Jacobian* leg, const IKMethod* method, int n, int threads, double tol,
+	std::vector<SweepResult>& res, std::vector<int>& hist, SweepStats& st) {
+	std::vector<std::thread> pool;
+	std::atomic<int> next(0);
+	std::chrono::steady_clock::time_point start;
+	int i;
+
+	res.assign(n * n * n, SweepResult());
+	hist.assign(IK_MAX_ITERS / SWEEP_BUCKET + 1, 0);
+	start = std::chrono::steady_clock::now();
+	for(i = 0; i < threads; i++) {
+		pool.push_back(std::thread(sweepWorker, leg, method, n, tol, &next, &res));
+	}
+	for(i = 0; i < threads; i++) {
+		pool[i].join();
+	}
+	st.wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	st.rejected = st.converged = st.stalled = st.iters = 0;
+	st.ms.clear();
+	for(i = 0; i < (int)res.size(); i++) {
+		if(res[i].rejected) {
+			st.rejected++;
+			continue;
+		}
+		st.converged += res[i].solve.converged;
+		st.stalled += res[i].solve.stalled;
+		st.iters += res[i].solve.iters;
+		hist[std::min(res[i].solve.iters, IK_MAX_ITERS) / SWEEP_BUCKET]++;
+		st.ms.push_back(res[i].solve.ms);
+	}
+	std::sort(st.ms.begin(), st.ms.end());
+}
+
+int main(int argc, char** argv) {
+	int n = argc > 1 ? atoi(argv[1]) : 16;
+	int threads = argc > 2 ? atoi(argv[2]) : (int)std::thread::hardware_concurrency();
+	double tol = argc > 3 ? atof(argv[3]) : 1e-4;
+	const char* which = argc > 4 ? argv[4] : "jacobian";
+	std::vector<SweepResult> res;
+	std::vector<int> hist;
+	//NULL stands for Jacobian::solve
+	std::vector<IKMethod*> methods;
+	IKMethod* m;
+	SweepStats st;
+	int i, j, peak = 0;
+	bool all = strcmp(which, "all") == 0;
+	Jacobian* leg;
+
+	if(all || strcmp(which, "jacobian") == 0) {
+		methods.push_back(NULL);
+	}
+	for(i = 0; i < IK_METHOD_COUNT; i++) {
+		m = createIKMethod((IKMethodType)i);
+		if(all || strcmp(which, m->name()) == 0) {
+			methods.push_back(m);
+		}
+		else {
+			delete m;
+		}
+	}
+	if(n < 1 || threads < 1 || methods.empty()) {
+		fprintf(stderr, "usage: iksweep [grid points per axis] [threads] [tolerance] [jacobian|pinv|dls|ccd|fabrik|all]\n");
+		return 1;
+	}
+
+	//As Gundan::initJacobian and beginIK
+	leg = createLeftLeg();
+	leg->setCache("gundanleg.jcache");
+	leg->setCompiled(leftLegJacobian, LEFTLEGJACOBIAN_HASH);
+	setLeftLegLimits(leg);
+	leg->useNullSpace(true);
+	leg->preprocess();
+
+	//Every method meets the same targets, so one table compares them
+	if(all) {
+		printf("%d targets on %d threads, tolerance %g\n\n", n * n * n, threads, tol);
+		printf("method    rejected  converged  stalled  iters   solves/s   p50 us   p99 us\n");
+		for(i = 0; i < (int)methods.size(); i++) {
+			sweep(leg, methods[i], n, threads, tol, res, hist, st);
+			printf("%-9s %8d %9.1f%% %8d %6.1f %10.0f %8.1f %8.1f\n",
+				methods[i] ? methods[i]->name() : "jacobian", st.rejected,
+				st.ms.empty() ? 0.0 : 100.0 * st.converged / st.ms.size(), st.stalled,
+				st.ms.empty() ? 0.0 : (double)st.iters / st.ms.size(), st.ms.size() / st.wall,
+				percentile(st.ms, 0.5) * 1e3, percentile(st.ms, 0.99) * 1e3);
+		}
+		for(i = 0; i < (int)methods.size(); i++) {
+			delete methods[i];
+		}
+		delete leg;
+		return 0;
+	}
+
+	sweep(leg, methods[0], n, threads, tol, res, hist, st);
+	for(i = 0; i < (int)hist.size(); i++) {
+		peak = std::max(peak, hist[i]);
+	}
+
+	printf("%d targets on %d threads, tolerance %g, method %s\n", (int)res.size(), threads, tol, which);
+	printf("rejected as out of reach %d, solved %d\n", st.rejected, (int)st.ms.size());
+	printf("converged %d (%.1f%%), stalled %d, out of iterations %d\n", st.converged,
+		st.ms.empty() ? 0.0 : 100.0 * st.converged / st.ms.size(), st.stalled, (int)st.ms.size() - st.converged - st.stalled);
+	printf("%.0f targets/s, %.0f solves/s, %.1f iterations per solve\n", res.size() / st.wall,
+		st.ms.size() / st.wall, st.ms.empty() ? 0.0 : (double)st.iters / st.ms.size());
+	printf("latency per solve: p50 %.1f us, p99 %.1f us, max %.1f us\n",
+		percentile(st.ms, 0.5) * 1e3, percentile(st.ms, 0.99) * 1e3, st.ms.empty() ? 0.0 : st.ms.back() * 1e3);
+
+	printf("\niterations\n");
+	for(i = 0; i < (int)hist.size(); i++) {
+		if(!hist[i]) {
+			continue;
+		}
+		printf("%4d-%-4d %6d ", i * SWEEP_BUCKET, i * SWEEP_BUCKET + SWEEP_BUCKET - 1, hist[i]);
+		for(j = 0; j < hist[i] * 50 / peak; j++) {
+			putchar('#');
+		}
+		putchar('\n');
+	}
+	delete methods[0];
+	delete leg;
+	return 0;
+}
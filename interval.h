@@ -0,0 +1,78 @@
+#ifndef __INTERVAL_HEADER__
+#define __INTERVAL_HEADER__
+
+#include <math.h>
+
+//Closed range [lo, hi]. Results of the operations below contain every
+//value the operation can take over its operand ranges. Rounding is not
+//directed, callers compare with a tolerance.
+struct Interval {
+	double lo, hi;
+
+	Interval(): lo(0), hi(0) {}
+	Interval(double x): lo(x), hi(x) {}
+	Interval(double l, double h): lo(l), hi(h) {}
+
+	double width() const { return hi - lo; }
+	double mid() const { return 0.5 * (lo + hi); }
+	bool contains(double x) const { return lo <= x && x <= hi; }
+};
+
+inline Interval operator+(const Interval& a, const Interval& b) {
+	return Interval(a.lo + b.lo, a.hi + b.hi);
+}
+
+inline Interval operator-(const Interval& a, const Interval& b) {
+	return Interval(a.lo - b.hi, a.hi - b.lo);
+}
+
+inline Interval operator-(const Interval& a) {
+	return Interval(-a.hi, -a.lo);
+}
+
+//Smallest interval holding both a and b
+inline Interval hull(double a, double b) {
+	return a < b ? Interval(a, b) : Interval(b, a);
+}
+
+inline Interval hull(const Interval& a, const Interval& b) {
+	return Interval(a.lo < b.lo ? a.lo : b.lo, a.hi > b.hi ? a.hi : b.hi);
+}
+
+inline Interval operator*(const Interval& a, const Interval& b) {
+	return hull(hull(a.lo * b.lo, a.lo * b.hi), hull(a.hi * b.lo, a.hi * b.hi));
+}
+
+//sin over [x.lo, x.hi]: the endpoints, widened to +-1 when a peak
+//pi/2 + 2k pi or trough -pi/2 + 2k pi lies inside
+inline Interval isin(const Interval& x) {
+	const double pi2 = 6.28318530717958647692, hpi = 1.57079632679489661923;
+	Interval r = hull(sin(x.lo), sin(x.hi));
+	if(x.width() >= pi2) {
+		return Interval(-1, 1);
+	}
+	if(ceil((x.lo - hpi) / pi2) <= floor((x.hi - hpi) / pi2)) {
+		r.hi = 1;
+	}
+	if(ceil((x.lo + hpi) / pi2) <= floor((x.hi + hpi) / pi2)) {
+		r.lo = -1;
+	}
+	return r;
+}
+
+//cos(x) = sin(x + pi/2)
+inline Interval icos(const Interval& x) {
+	const double hpi = 1.57079632679489661923;
+	Interval e = hull(cos(x.lo), cos(x.hi));
+	Interval r = isin(Interval(x.lo + hpi, x.hi + hpi));
+	//Exact endpoints, the shifted ones carry rounding error
+	if(r.lo > -1) {
+		r.lo = e.lo;
+	}
+	if(r.hi < 1) {
+		r.hi = e.hi;
+	}
+	return r;
+}
+
+#endif
@@ -2,27 +2,48 @@
 #include "mathfunc.h"
 #include "euclid.h"
 #include "linearalgebra.h"
+#include "tape.h"
+#include "exprio.h"
+#include <stdio.h>
+#include <ctype.h>
+#include <string.h>
 #include <vector>
+#include <algorithm>
+#include <chrono>
 
 #define M_PI (3.14159265)
 #define CALC_EPS (1e-6)
+//Cache file header, bump the version when the layout changes
+#define JACOB_CACHE_MAGIC (0x4243414a)
+#define JACOB_CACHE_VERSION (3)
+//stepDelta damping, relative to the largest diagonal of J J^T, and
+//the number of times it may be raised tenfold in one step
+#define JACOB_LM_MU (1e-4)
+#define JACOB_LM_TRIES (6)
+//Longest joint step newtonStep takes, in radians
+#define JACOB_NEWTON_RADIUS (0.3)
+//Joint motion towards the middle of the limits in null space steps,
+//per unit of distance from it relative to half the range
+#define JACOB_NULL_GAIN (0.1)
 
 Jacobian::Jacobian()
-:deg_freedom(0), rawTrans(4, 4), Jacob(NULL), Refined(4),
-max_constraint(NULL), min_constraint(NULL), initPos(4),
-state(NOT_INIT) {}
+:initPos(4), hand_trans(false), use_chain(false), Refined(4), rawTrans(4, 4),
+hessian(false), null_space(false), compiled(NULL), compiled_hash(0), deg_freedom(0),
+max_constraint(NULL), min_constraint(NULL), nodes_before(0), nodes_after(0),
+state(NOT_INIT), mode(JACOB_GEOMETRIC) {
+	init_pos[0] = init_pos[1] = init_pos[2] = 0;
+}
 Jacobian::Jacobian(int freedom)
-:deg_freedom(freedom), rawTrans(4, 4), Jacob(NULL), Refined(4),
-max_constraint(NULL), min_constraint(NULL), initPos(4),
-state(NOT_INIT) {
+:initPos(4), hand_trans(false), use_chain(false), Refined(4), rawTrans(4, 4),
+hessian(false), null_space(false), compiled(NULL), compiled_hash(0), deg_freedom(freedom),
+max_constraint(NULL), min_constraint(NULL), nodes_before(0), nodes_after(0),
+state(NOT_INIT), mode(JACOB_GEOMETRIC) {
 	int i, j;
 	for(i = 0; i < 4; i++) {
 		for(j = 0; j < 4; j++) {
 			rawTrans[i][j] = (i == j);
 		}
 	}
-	Jacob = new Linear::Mat<ExprP>(deg_freedom, 4);
-
 	max_constraint = new RealVec(deg_freedom);
 	min_constraint = new RealVec(deg_freedom);
 	for(i = 0; i < deg_freedom; i++) {
@@ -34,12 +55,10 @@ state(NOT_INIT) {
 	initPos[1] = 0;
 	initPos[2] = 0;
 	initPos[3] = 1;
+	init_pos[0] = init_pos[1] = init_pos[2] = 0;
 }
 
 Jacobian::~Jacobian() {
-	if(Jacob) {
-		delete Jacob;
-	}
 	if(max_constraint) {
 		delete max_constraint;
 	}
@@ -54,181 +73,1209 @@ void Jacobian::setInitVec(double x, double y, double z) {
 	initPos[0] = x;
 	initPos[1] = y;
 	initPos[2] = z;
+	init_pos[0] = x;
+	init_pos[1] = y;
+	init_pos[2] = z;
 }
 
 void Jacobian::pushRotV(int varid, double x, double y, double z) {
-	RealVec axis(3);
-	Linear::Mat<ExprP> rotMat(4, 4);
-	ExprP c(new CosFunc(varid)), s(new SinFunc(varid));
-	axis[0] = x; axis[1] = y; axis[2] = z;
-	axis = axis.norm();
-	x = axis[0]; y = axis[1]; z = axis[2];
+	assert(varid < deg_freedom && chain.size() < CHAIN_MAX_LINKS);
+	chain.pushRotV(varid, x, y, z);
+	state = NOT_INIT;
+}
 
+void Jacobian::pushRotC(double angle, double x, double y, double z) {
+	assert(chain.size() < CHAIN_MAX_LINKS);
+	chain.pushRotC(angle, x, y, z);
 	state = NOT_INIT;
+}
 
-	rotMat[0][0] = x * x * (1.0 - c) + c;
-	rotMat[0][1] = x * y * (1.0 - c) - z * s;
-	rotMat[0][2] = x * z * (1.0 - c) + y * s;
-	rotMat[0][3] = 0;
+void Jacobian::pushTransC(double x, double y, double z) {
+	assert(chain.size() < CHAIN_MAX_LINKS);
+	chain.pushTransC(x, y, z);
+	state = NOT_INIT;
+}
 
-	rotMat[1][0] = y * x * (1.0 - c) + z * s;
-	rotMat[1][1] = y * y * (1.0 - c) + c;
-	rotMat[1][2] = y * z * (1.0 - c) - x * s;
-	rotMat[1][3] = 0;
+//From here on the chain only exists as its symbolic product
+void Jacobian::setTrans(int i, int j, const ExprP& e) {
+	if(!hand_trans) {
+		rawTrans = chain.symbolic();
+		chain.clear();
+		hand_trans = true;
+	}
+	rawTrans[i][j] = e;
+	state = NOT_INIT;
+}
 
-	rotMat[2][0] = x * z * (1.0 - c) - y * s;
-	rotMat[2][1] = y * z * (1.0 - c) + x * s;
-	rotMat[2][2] = z * z * (1.0 - c) + c;
-	rotMat[2][3] = 0;
+void Jacobian::setMode(JacobMode m) {
+	if(m != mode) {
+		mode = m;
+		state = NOT_INIT;
+	}
+}
 
-	rotMat[3][0] = 0;
-	rotMat[3][1] = 0;
-	rotMat[3][2] = 0;
-	rotMat[3][3] = 1;
+void Jacobian::setCompiled(JacobFunc f, unsigned int hash) {
+	compiled = f;
+	compiled_hash = hash;
+	mode = JACOB_COMPILED;
+	state = NOT_INIT;
+}
 
-	rawTrans *= rotMat;
+void Jacobian::setConstraint(int varid, double min, double max) {
+	assert(varid < deg_freedom && varid >= 0);
+	(*max_constraint)[varid] = max;
+	(*min_constraint)[varid] = min;
 }
 
-void Jacobian::pushRotC(double angle, double x, double y, double z) {
-	RealVec axis(3);
-	Linear::Mat<ExprP> rotMat(4, 4);
-	double c = cos(angle), s = sin(angle);
-	axis[0] = x; axis[1] = y; axis[2] = z;
-	axis = axis.norm();
-	x = axis[0]; y = axis[1]; z = axis[2];
-	
-	state = NOT_INIT;
+void Jacobian::getConstraint(int varid, double& min, double& max) const {
+	assert(varid < deg_freedom && varid >= 0);
+	max = (*max_constraint)[varid];
+	min = (*min_constraint)[varid];
+}
+
+int Jacobian::dof() const {
+	return deg_freedom;
+}
+
+void Jacobian::setCache(const char* path) {
+	cache_path = path ? path : "";
+}
+
+void Jacobian::useHessian(bool on) {
+	if(on != hessian) {
+		hessian = on;
+		state = NOT_INIT;
+	}
+}
+
+void Jacobian::useNullSpace(bool on) {
+	null_space = on;
+}
+
+void Jacobian::preprocess() {
+	//AD modes only need the position, the others its partials as well
+	bool partials = mode != JACOB_REVERSE && mode != JACOB_FORWARD;
+	int order = hessian ? 2 : partials;
+	std::vector<ExprP> all;
+	unsigned long long masks[4];
+	JacobEntry e;
+	HessEntry h;
+	unsigned int key;
+	int i;
+	if(state == READY) {
+		return;
+	}
+
+	//A chain of links is evaluated numerically, nothing to derive
+	use_chain = (mode == JACOB_CHAIN || mode == JACOB_GEOMETRIC) && !hand_trans && !hessian;
+	if(use_chain) {
+		entry.clear();
+		hentry.clear();
+		Jacob.clear();
+		Hess.clear();
+		trans_tape.compile(NULL, 0);
+		jacob_tape.compile(NULL, 0);
+		hess_tape.compile(NULL, 0);
+		trans_state.reset();
+		nodes_before = nodes_after = 0;
+		state = READY;
+		return;
+	}
+	if(!hand_trans) {
+		rawTrans = chain.symbolic();
+	}
+	Refined = rawTrans * initPos;
 
-	rotMat[0][0] = x * x * (1.0 - c) + c;
-	rotMat[0][1] = x * y * (1.0 - c) - z * s;
-	rotMat[0][2] = x * z * (1.0 - c) + y * s;
-	rotMat[0][3] = 0;
+	//Only partials by variables a row depends on can be nonzero. The
+	//homogeneous row is constant and never has any.
+	varMasks(&Refined[0], 4, masks);
+	entry.clear();
+	hentry.clear();
+	for(e.row = 0; e.row < 3 && order > 0; e.row++) {
+		for(e.col = 0; e.col < deg_freedom; e.col++) {
+			if(masks[e.row] & varBit(e.col)) {
+				entry.push_back(e);
+			}
+		}
+	}
+	for(h.row = 0; h.row < 3 && order > 1; h.row++) {
+		for(h.a = 0; h.a < deg_freedom; h.a++) {
+			for(h.b = h.a; h.b < deg_freedom; h.b++) {
+				if((masks[h.row] & varBit(h.a)) && (masks[h.row] & varBit(h.b))) {
+					hentry.push_back(h);
+				}
+			}
+		}
+	}
 
-	rotMat[1][0] = y * x * (1.0 - c) + z * s;
-	rotMat[1][1] = y * y * (1.0 - c) + c;
-	rotMat[1][2] = y * z * (1.0 - c) - x * s;
-	rotMat[1][3] = 0;
+	key = chainKey(order);
+	if(!loadCache(key, all)) {
+		derive(order, all);
+		saveCache(key, all);
+	}
+	dropZeros(all);
+	for(i = 0; i < 4; i++) {
+		Refined[i] = all[i];
+	}
+	Jacob.assign(all.begin() + 4, all.begin() + 4 + entry.size());
+	Hess.assign(all.begin() + 4 + entry.size(), all.end());
 
-	rotMat[2][0] = x * z * (1.0 - c) - y * s;
-	rotMat[2][1] = y * z * (1.0 - c) + x * s;
-	rotMat[2][2] = z * z * (1.0 - c) + c;
-	rotMat[2][3] = 0;
+	//Position and Jacobian share one tape so common terms run once per step
+	trans_tape.compile(&Refined[0], 4);
+	trans_state.reset();
+	if(partials) {
+		jacob_tape.compile(&all[0], 4 + (int)entry.size());
+	}
+	else {
+		jacob_tape.compile(NULL, 0);
+	}
+	if(order > 1) {
+		hess_tape.compile(&all[0], (int)all.size());
+	}
+	else {
+		hess_tape.compile(NULL, 0);
+	}
 
-	rotMat[3][0] = 0;
-	rotMat[3][1] = 0;
-	rotMat[3][2] = 0;
-	rotMat[3][3] = 1;
+	//Stale generated code falls back to the tape
+	if(mode == JACOB_COMPILED && compiled && jacob_tape.hash() != compiled_hash) {
+		fprintf(stderr, "Jacobian: generated code does not match the chain, using the tape\n");
+		compiled = NULL;
+	}
 
-	rawTrans *= rotMat;
+	state = READY;
 }
 
-void Jacobian::pushTransC(double x, double y, double z) {
-	Linear::Mat<ExprP> transMat(4, 4);
-	
-	state = NOT_INIT;
+static bool isZero(const ExprP& e) {
+	return e->type() == EXPR_CONST && ((const ConstFunc*)e.get())->value() == 0;
+}
 
-	transMat[0][0] = 1;
-	transMat[0][1] = 0;
-	transMat[0][2] = 0;
-	transMat[0][3] = x;
+//The masks only rule out partials by variables a row never mentions.
+//Others only vanish once simplified, such as d/d0 of (1 - c0) + c0, and
+//are dropped from the entries and from all here.
+void Jacobian::dropZeros(std::vector<ExprP>& all) {
+	const int firsts = (int)entry.size();
+	int i, k = 0, n = 4;
+	for(i = 0; i < firsts; i++) {
+		if(!isZero(all[4 + i])) {
+			entry[k++] = entry[i];
+			all[n++] = all[4 + i];
+		}
+	}
+	entry.resize(k);
+	k = 0;
+	for(i = 0; i < (int)hentry.size(); i++) {
+		if(!isZero(all[4 + firsts + i])) {
+			hentry[k++] = hentry[i];
+			all[n++] = all[4 + firsts + i];
+		}
+	}
+	hentry.resize(k);
+	all.resize(n);
+}
 
-	transMat[1][0] = 0;
-	transMat[1][1] = 1;
-	transMat[1][2] = 0;
-	transMat[1][3] = y;
+//Simplified position, followed by the first partials of the packed
+//entries when order is 1 or more and the second when it is 2
+void Jacobian::derive(int order, std::vector<ExprP>& all) {
+	std::vector<int> first(3 * deg_freedom, -1);
+	int i;
+	all.assign(&Refined[0], &Refined[0] + 4);
+	//Differentiate raw, then simplify values and partials as one batch
+	for(i = 0; i < (int)entry.size() && order > 0; i++) {
+		first[entry[i].row * deg_freedom + entry[i].col] = (int)all.size();
+		all.push_back(Refined[entry[i].row]->pd(entry[i].col));
+	}
+	//Second partials come from the raw first ones, so both orders
+	//share their subterms through the intern table and the tape
+	for(i = 0; i < (int)hentry.size() && order > 1; i++) {
+		all.push_back(all[first[hentry[i].row * deg_freedom + hentry[i].a]]->pd(hentry[i].b));
+	}
+	nodes_before = nodeCount(&all[0], (int)all.size());
+	simplify(&all[0], (int)all.size());
+	nodes_after = nodeCount(&all[0], (int)all.size());
+}
 
-	transMat[2][0] = 0;
-	transMat[2][1] = 0;
-	transMat[2][2] = 1;
-	transMat[2][3] = z;
+//Identifies the unsimplified chain, so edits to it miss the cache
+unsigned int Jacobian::chainKey(int order) const {
+	std::vector<unsigned char> buf;
+	int head[2];
+	head[0] = deg_freedom;
+	head[1] = order;
+	serialize(&Refined[0], 4, buf);
+	return contentHash(buf.size() ? &buf[0] : NULL, buf.size(),
+		contentHash((const unsigned char*)head, sizeof(head)));
+}
 
-	transMat[3][0] = 0;
-	transMat[3][1] = 0;
-	transMat[3][2] = 0;
-	transMat[3][3] = 1;
+bool Jacobian::loadCache(unsigned int key, std::vector<ExprP>& all) {
+	std::vector<unsigned char> buf;
+	FILE* f;
+	int head[6], n;
+	long size;
+	bool ok;
+	if(cache_path.empty() || (f = fopen(cache_path.c_str(), "rb")) == NULL) {
+		return false;
+	}
+	ok = fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) >= 0 && fseek(f, 0, SEEK_SET) == 0;
+	//magic, version, key, outputs, nodes before/after, payload size. The
+	//payload is the rest of the file and holds an int per output. A key
+	//may collide, so the outputs must also be the ones preprocess packed.
+	ok = ok && fread(head, sizeof(int), 6, f) == 6 && head[0] == JACOB_CACHE_MAGIC &&
+		head[1] == JACOB_CACHE_VERSION && (unsigned int)head[2] == key && head[5] > 0 &&
+		head[5] == size - (long)sizeof(head) && head[3] == 4 + (int)(entry.size() + hentry.size()) &&
+		(size_t)head[3] <= head[5] / sizeof(int);
+	if(ok) {
+		buf.resize(head[5]);
+		ok = fread(&buf[0], 1, buf.size(), f) == buf.size();
+	}
+	fclose(f);
+	if(!ok) {
+		return false;
+	}
+	n = head[3];
+	all.resize(n);
+	if(!deserialize(&buf[0], buf.size(), &all[0], n, deg_freedom)) {
+		all.clear();
+		return false;
+	}
+	nodes_before = head[4];
+	nodes_after = nodeCount(&all[0], n);
+	return true;
+}
 
-	rawTrans *= transMat;
+void Jacobian::saveCache(unsigned int key, const std::vector<ExprP>& all) const {
+	std::vector<unsigned char> buf;
+	FILE* f;
+	int head[6];
+	if(cache_path.empty()) {
+		return;
+	}
+	serialize(&all[0], (int)all.size(), buf);
+	head[0] = JACOB_CACHE_MAGIC;
+	head[1] = JACOB_CACHE_VERSION;
+	head[2] = (int)key;
+	head[3] = (int)all.size();
+	head[4] = nodes_before;
+	head[5] = (int)buf.size();
+	if((f = fopen(cache_path.c_str(), "wb")) == NULL) {
+		return;
+	}
+	if(fwrite(head, sizeof(int), 6, f) != 6 || fwrite(&buf[0], 1, buf.size(), f) != buf.size()) {
+		fclose(f);
+		remove(cache_path.c_str());
+		return;
+	}
+	fclose(f);
 }
 
-void Jacobian::setTrans(int i, int j, const ExprP& e) {
-	rawTrans[i][j] = e;
+RealVec Jacobian::stepDelta(const RealVec& cTheta, const RealVec& desPos, double distance, bool &finished) const {
+	RealVec ret(deg_freedom);
+	stepDelta(&cTheta[0], &desPos[0], distance, &ret[0], finished);
+	return ret;
 }
 
-void Jacobian::setConstraint(int varid, double min, double max) {
-	assert(varid < deg_freedom && varid >= 0);
-	(*max_constraint)[varid] = max;
-	(*min_constraint)[varid] = min;
-	state = NOT_INIT;
+JacobSolve Jacobian::solve(const RealVec& target, const RealVec& initialTheta, double tolerance, int maxIters, double timeBudget, double step) const {
+	return iterate(&target[0], NULL, 0, initialTheta, tolerance, maxIters, timeBudget, step);
 }
 
-void Jacobian::preprocess() {
+JacobSolve Jacobian::solvePose(const RealVec& target, const RealMat& rot, double rotWeight, const RealVec& initialTheta, double tolerance, int maxIters, double timeBudget, double step) const {
+	double r[9];
 	int i, j;
-	if(state == READY) {
-		return;
+	for(i = 0; i < 3; i++) {
+		for(j = 0; j < 3; j++) {
+			r[i * 3 + j] = rot[i][j];
+		}
 	}
-	Refined = rawTrans * initPos;
+	return iterate(&target[0], r, rotWeight, initialTheta, tolerance, maxIters, timeBudget, step);
+}
 
-	for(i = 0; i < 4; i++) {
-		for(j = 0; j < deg_freedom; j++) {
-			(*Jacob)[i][j] = Refined[i].pd(j);
+void Jacobian::evalPose(const RealVec& theta, RealVec& pos, RealMat& rot) const {
+	double jac[6 * JACOB_MAX_DOF], r[9];
+	int i, j;
+	assert(state == READY && !hand_trans);
+	pos = RealVec(4);
+	rot = RealMat(3, 3);
+	chain.pose(&theta[0], deg_freedom, init_pos, &pos[0], r, jac, deg_freedom);
+	pos[3] = 1;
+	for(i = 0; i < 3; i++) {
+		for(j = 0; j < 3; j++) {
+			rot[i][j] = r[i * 3 + j];
 		}
 	}
+}
+
+//stepDelta, or stepPose with desRot, until one of the ends of solve
+JacobSolve Jacobian::iterate(const double* desPos, const double* desRot, double rotWeight, const RealVec& initialTheta, double tolerance, int maxIters, double timeBudget, double step) const {
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point start = Clock::now();
+	JacobSolve ret;
+	double cur[JACOB_MAX_DOF], next[JACOB_MAX_DOF], delta;
+	bool finished = false;
+	int i;
+
+	assert(state == READY && deg_freedom <= JACOB_MAX_DOF);
+	ret.iters = 0;
+	ret.converged = ret.stalled = ret.timedOut = false;
+	for(i = 0; i < deg_freedom; i++) {
+		cur[i] = initialTheta[i];
+	}
+	ret.error = sqrt(desRot ? poseError(cur, desPos, desRot, rotWeight) : posError(cur, desPos));
 
-	state = READY;
+	while(ret.error >= tolerance) {
+		if(ret.iters >= maxIters) {
+			break;
+		}
+		if(timeBudget > 0 && std::chrono::duration<double, std::milli>(Clock::now() - start).count() >= timeBudget) {
+			ret.timedOut = true;
+			break;
+		}
+		//Same schedule as the interactive solver, short steps first
+		ret.iters++;
+		delta = step > 0 ? step : std::min(0.01 * sqrt((double)ret.iters), 0.1);
+		if(desRot) {
+			stepPose(cur, desPos, desRot, rotWeight, delta, next, finished);
+		}
+		else {
+			stepDelta(cur, desPos, delta, next, finished);
+		}
+		for(i = 0; i < deg_freedom; i++) {
+			cur[i] = next[i];
+		}
+		ret.error = sqrt(desRot ? poseError(cur, desPos, desRot, rotWeight) : posError(cur, desPos));
+		if(finished && ret.error >= tolerance) {
+			ret.stalled = true;
+			break;
+		}
+	}
+	ret.converged = ret.error < tolerance;
+
+	ret.theta = RealVec(deg_freedom);
+	for(i = 0; i < deg_freedom; i++) {
+		ret.theta[i] = cur[i];
+	}
+	ret.ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	return ret;
 }
 
-RealVec Jacobian::stepDelta(const RealVec& cTheta, const RealVec& desPos, double distance, bool &finished) {
-	int i, j;
-	RealVec ret, ans;
-	RealVec delta = desPos - evalTrans(cTheta);
-	RealMat evJacob(deg_freedom, 4);
-	RealMat trans;
-	double mmin, mmax, l;
+//Solves the n x n positive definite a x = b by Cholesky, a has rows
+//of stride doubles
+static void cholN(const double* a, int stride, int n, const double* b, double* x) {
+	double l[6][6], s;
+	int i, j, k;
+	assert(n <= 6);
+	for(i = 0; i < n; i++) {
+		for(j = 0; j <= i; j++) {
+			s = a[i * stride + j];
+			for(k = 0; k < j; k++) {
+				s -= l[i][k] * l[j][k];
+			}
+			l[i][j] = i == j ? sqrt(s) : s / l[j][j];
+		}
+	}
+	for(i = 0; i < n; i++) {
+		s = b[i];
+		for(k = 0; k < i; k++) {
+			s -= l[i][k] * x[k];
+		}
+		x[i] = s / l[i][i];
+	}
+	for(i = n - 1; i >= 0; i--) {
+		s = x[i];
+		for(k = i + 1; k < n; k++) {
+			s -= l[k][i] * x[k];
+		}
+		x[i] = s / l[i][i];
+	}
+}
 
-	assert(state == READY);
+//Solves the 3 x 3 positive definite a x = b by Cholesky
+static void chol3(const double a[3][3], const double* b, double* x) {
+	double l[3][3], s;
+	int i, j, k;
+	for(i = 0; i < 3; i++) {
+		for(j = 0; j <= i; j++) {
+			s = a[i][j];
+			for(k = 0; k < j; k++) {
+				s -= l[i][k] * l[j][k];
+			}
+			l[i][j] = i == j ? sqrt(s) : s / l[j][j];
+		}
+	}
+	for(i = 0; i < 3; i++) {
+		s = b[i];
+		for(k = 0; k < i; k++) {
+			s -= l[i][k] * x[k];
+		}
+		x[i] = s / l[i][i];
+	}
+	for(i = 2; i >= 0; i--) {
+		s = x[i];
+		for(k = i + 1; k < 3; k++) {
+			s -= l[k][i] * x[k];
+		}
+		x[i] = s / l[i][i];
+	}
+}
 
-	for(i = 0; i < 4; i++) {
-		for(j = 0; j < deg_freedom; j++) {
-			evJacob[i][j] = (*Jacob)[i][j](cTheta);
+void Jacobian::stepDelta(const double* cTheta, const double* desPos, double distance, double* next, bool& finished) const {
+	double jac[3][JACOB_MAX_DOF], pos[4], e[3], jjt[3][3], damped[3][3], y[3];
+	double ret[JACOB_MAX_DOF];
+	double err = 0, mu = 0, l;
+	int i, j, k, tries;
+
+	assert(state == READY && deg_freedom <= JACOB_MAX_DOF);
+
+	evalRows(cTheta, pos, jac);
+	for(i = 0; i < 3; i++) {
+		e[i] = desPos[i] - pos[i];
+		err += e[i] * e[i];
+	}
+	//J J^T is 3 x 3 whatever the DOF, damping is relative to its scale
+	for(i = 0; i < 3; i++) {
+		for(j = 0; j < 3; j++) {
+			jjt[i][j] = 0;
+			for(k = 0; k < deg_freedom; k++) {
+				jjt[i][j] += jac[i][k] * jac[j][k];
+			}
+		}
+		if(jjt[i][i] > mu) {
+			mu = jjt[i][i];
+		}
+	}
+	mu = mu > 0 ? mu * JACOB_LM_MU : JACOB_LM_MU;
+
+	//Near a singularity such as a straight knee the undamped step
+	//explodes, raise mu until the step improves the error
+	for(tries = 0; tries < JACOB_LM_TRIES; tries++, mu *= 10) {
+		if(null_space) {
+			activeStep(cTheta, jac, e, mu, distance, ret, next);
+		}
+		else {
+			for(i = 0; i < 3; i++) {
+				for(j = 0; j < 3; j++) {
+					damped[i][j] = jjt[i][j] + (i == j ? mu : 0);
+				}
+			}
+			chol3(damped, e, y);
+			for(k = 0; k < deg_freedom; k++) {
+				ret[k] = jac[0][k] * y[0] + jac[1][k] * y[1] + jac[2][k] * y[2];
+			}
+			limitStep(cTheta, ret, distance, next);
+		}
+		if(tries + 1 == JACOB_LM_TRIES || posError(next, desPos) < err) {
+			break;
 		}
 	}
-	trans = evJacob.transpose() * evJacob;
-	trans = trans.inv() * evJacob.transpose();
 
-	ret = trans * delta;
-	ans = cTheta + ret * distance;
+	l = 0;
+	for(i = 0; i < deg_freedom; i++) {
+		l += ret[i] * ret[i];
+	}
+	finished = sqrt(l) <= CALC_EPS;
+}
+
+//stepDelta of useNullSpace at damping mu. Joints the step would carry
+//past a limit are pinned there, their motion is taken out of e and the
+//free joints are solved again, until no free joint leaves its range.
+//A pinned joint the remaining error pulls back inside is freed once.
+//With more free joints than the end has coordinates they also move
+//towards the middle of their ranges, as far as that leaves the end.
+void Jacobian::activeStep(const double* cTheta, const double (*jac)[JACOB_MAX_DOF], const double* e, double mu, double distance, double* ret, double* next) const {
+	double r[3], jjt[3][3], proj[3][3], y[3], jz[3], w[3], z[JACOB_MAX_DOF];
+	double mmin, mmax, g, scale;
+	//+1 pinned at the upper limit, -1 at the lower, 0 free
+	int pinned[JACOB_MAX_DOF];
+	bool freed[JACOB_MAX_DOF], changed = true;
+	int i, j, k, pass, free;
+
+	assert(distance > 0);
+	for(k = 0; k < deg_freedom; k++) {
+		pinned[k] = 0;
+		freed[k] = false;
+	}
+	//Every pass pins or frees a joint, or is the last
+	for(pass = 0; changed && pass <= 2 * deg_freedom; pass++) {
+		changed = false;
+		free = 0;
+		for(i = 0; i < 3; i++) {
+			r[i] = e[i];
+			jz[i] = 0;
+			for(j = 0; j < 3; j++) {
+				jjt[i][j] = 0;
+			}
+		}
+		for(k = 0; k < deg_freedom; k++) {
+			if(pinned[k]) {
+				for(i = 0; i < 3; i++) {
+					r[i] -= jac[i][k] * ret[k];
+				}
+				continue;
+			}
+			free++;
+			for(i = 0; i < 3; i++) {
+				for(j = 0; j < 3; j++) {
+					jjt[i][j] += jac[i][k] * jac[j][k];
+				}
+			}
+		}
+		//Free part J^T (J J^T + mu)^-1 r
+		scale = std::max(jjt[0][0], std::max(jjt[1][1], jjt[2][2]));
+		for(i = 0; i < 3; i++) {
+			for(j = 0; j < 3; j++) {
+				proj[i][j] = jjt[i][j] + (i == j ? CALC_EPS * scale + CALC_EPS : 0);
+				jjt[i][j] += i == j ? mu : 0;
+			}
+		}
+		chol3(jjt, r, y);
+		//plus z less what J sees of it. The damped inverse would let
+		//mu z through and hold the end off the target.
+		for(k = 0; k < deg_freedom; k++) {
+			z[k] = 0;
+			if(pinned[k] || free <= 3) {
+				continue;
+			}
+			mmin = (*min_constraint)[k];
+			mmax = (*max_constraint)[k];
+			z[k] = JACOB_NULL_GAIN * (mmin + mmax - 2 * cTheta[k]) / (mmax - mmin + CALC_EPS);
+			for(i = 0; i < 3; i++) {
+				jz[i] += jac[i][k] * z[k];
+			}
+		}
+		chol3(proj, jz, w);
+		for(k = 0; k < deg_freedom; k++) {
+			if(pinned[k]) {
+				continue;
+			}
+			ret[k] = jac[0][k] * (y[0] - w[0]) + jac[1][k] * (y[1] - w[1]) + jac[2][k] * (y[2] - w[2]) + z[k];
+			mmin = (*min_constraint)[k];
+			mmax = (*max_constraint)[k];
+			if(cTheta[k] + ret[k] * distance > mmax + CALC_EPS) {
+				ret[k] = (mmax - cTheta[k]) / distance;
+				pinned[k] = 1;
+				changed = true;
+			}
+			else if(cTheta[k] + ret[k] * distance < mmin - CALC_EPS) {
+				ret[k] = (mmin - cTheta[k]) / distance;
+				pinned[k] = -1;
+				changed = true;
+			}
+		}
+		if(changed) {
+			continue;
+		}
+		//Error left over once the free joints have moved
+		for(k = 0; k < deg_freedom; k++) {
+			if(!pinned[k]) {
+				for(i = 0; i < 3; i++) {
+					r[i] -= jac[i][k] * ret[k];
+				}
+			}
+		}
+		for(k = 0; k < deg_freedom; k++) {
+			g = jac[0][k] * r[0] + jac[1][k] * r[1] + jac[2][k] * r[2];
+			if(pinned[k] && !freed[k] && g * pinned[k] < 0) {
+				pinned[k] = 0;
+				freed[k] = changed = true;
+			}
+		}
+	}
+	for(k = 0; k < deg_freedom; k++) {
+		next[k] = cTheta[k] + ret[k] * distance;
+	}
+}
+
+//Cuts ret where cTheta + ret * distance leaves the constraints, and
+//writes that sum to next
+void Jacobian::limitStep(const double* cTheta, double* ret, double distance, double* next) const {
+	double mmin, mmax;
+	int i;
 	for(i = 0; i < deg_freedom; i++) {
 		mmin = (*min_constraint)[i];
 		mmax = (*max_constraint)[i];
-		if(ans[i] > mmax + CALC_EPS) {
+		next[i] = cTheta[i] + ret[i] * distance;
+		if(next[i] > mmax + CALC_EPS) {
 			if(cTheta[i] < mmax + CALC_EPS || ret[i] > CALC_EPS) {
 				ret[i] = mmax - cTheta[i];
 			}
 		}
-		else if(ans[i] < mmin - CALC_EPS) {
+		else if(next[i] < mmin - CALC_EPS) {
 			if(cTheta[i] > mmin - CALC_EPS || ret[i] < -CALC_EPS) {
 				ret[i] = mmin - cTheta[i];
 			}
 		}
+		next[i] = cTheta[i] + ret[i] * distance;
 	}
+}
 
-	l = ret.modulus();
-	if(l <= CALC_EPS && l >= -CALC_EPS) {
-		finished = true;
+//Axis-angle vector of the rotation taking cur to des, both 3 x 3 row
+//major: the rotation vector of des cur^T
+static void rotError(const double* des, const double* cur, double* e) {
+	double r[3][3], s, c, a;
+	int i, j;
+	for(i = 0; i < 3; i++) {
+		for(j = 0; j < 3; j++) {
+			r[i][j] = des[i * 3] * cur[j * 3] + des[i * 3 + 1] * cur[j * 3 + 1] + des[i * 3 + 2] * cur[j * 3 + 2];
+		}
+	}
+	e[0] = 0.5 * (r[2][1] - r[1][2]);
+	e[1] = 0.5 * (r[0][2] - r[2][0]);
+	e[2] = 0.5 * (r[1][0] - r[0][1]);
+	s = sqrt(e[0] * e[0] + e[1] * e[1] + e[2] * e[2]);
+	c = 0.5 * (r[0][0] + r[1][1] + r[2][2] - 1);
+	//The skew part alone is sin(angle) axis, scale it up to angle axis
+	if(s > CALC_EPS) {
+		a = atan2(s, c) / s;
+		e[0] *= a; e[1] *= a; e[2] *= a;
+	}
+}
+
+//Stacked position and weighted orientation residuals
+void Jacobian::poseResidual(const double* theta, const double* desPos, const double* desRot, double rotWeight, double* jac, double* e) const {
+	double pos[3], rot[9];
+	int i, j;
+	assert(!hand_trans);
+	chain.pose(theta, deg_freedom, init_pos, pos, rot, jac, deg_freedom);
+	for(i = 0; i < 3; i++) {
+		e[i] = desPos[i] - pos[i];
+	}
+	rotError(desRot, rot, e + 3);
+	for(i = 3; i < 6; i++) {
+		e[i] *= rotWeight;
+		for(j = 0; jac && j < deg_freedom; j++) {
+			jac[i * deg_freedom + j] *= rotWeight;
+		}
+	}
+}
+
+double Jacobian::poseError(const double* theta, const double* desPos, const double* desRot, double rotWeight) const {
+	double e[6], ret = 0;
+	int i;
+	poseResidual(theta, desPos, desRot, rotWeight, NULL, e);
+	for(i = 0; i < 6; i++) {
+		ret += e[i] * e[i];
+	}
+	return ret;
+}
+
+void Jacobian::stepPose(const double* cTheta, const double* desPos, const double* desRot, double rotWeight, double distance, double* next, bool& finished) const {
+	double jac[6 * JACOB_MAX_DOF], e[6], ret[JACOB_MAX_DOF];
+	double a[6][6], damped[6][6], b[6], y[6];
+	double err = 0, mu = 0, l;
+	int i, j, k, n, tries;
+	//Normal equations in the smaller of joint and residual space
+	const bool joints = deg_freedom <= 6;
+
+	assert(state == READY && deg_freedom <= JACOB_MAX_DOF);
+	n = joints ? deg_freedom : 6;
+	poseResidual(cTheta, desPos, desRot, rotWeight, jac, e);
+	for(i = 0; i < 6; i++) {
+		err += e[i] * e[i];
+	}
+	//J^T J and J^T e, or J J^T and e
+	for(i = 0; i < n; i++) {
+		for(j = 0; j < n; j++) {
+			a[i][j] = 0;
+			for(k = 0; k < (joints ? 6 : deg_freedom); k++) {
+				a[i][j] += joints ? jac[k * deg_freedom + i] * jac[k * deg_freedom + j] :
+					jac[i * deg_freedom + k] * jac[j * deg_freedom + k];
+			}
+		}
+		b[i] = 0;
+		if(joints) {
+			for(k = 0; k < 6; k++) {
+				b[i] += jac[k * deg_freedom + i] * e[k];
+			}
+		}
+		else {
+			b[i] = e[i];
+		}
+		if(a[i][i] > mu) {
+			mu = a[i][i];
+		}
+	}
+	mu = mu > 0 ? mu * JACOB_LM_MU : JACOB_LM_MU;
+
+	for(tries = 0; tries < JACOB_LM_TRIES; tries++, mu *= 10) {
+		for(i = 0; i < n; i++) {
+			for(j = 0; j < n; j++) {
+				damped[i][j] = a[i][j] + (i == j ? mu : 0);
+			}
+		}
+		cholN(damped[0], 6, n, b, y);
+		for(k = 0; k < deg_freedom; k++) {
+			if(joints) {
+				ret[k] = y[k];
+			}
+			else {
+				ret[k] = 0;
+				for(i = 0; i < 6; i++) {
+					ret[k] += jac[i * deg_freedom + k] * y[i];
+				}
+			}
+		}
+		limitStep(cTheta, ret, distance, next);
+		if(tries + 1 == JACOB_LM_TRIES || poseError(next, desPos, desRot, rotWeight) < err) {
+			break;
+		}
+	}
+
+	l = 0;
+	for(i = 0; i < deg_freedom; i++) {
+		l += ret[i] * ret[i];
+	}
+	finished = sqrt(l) <= CALC_EPS;
+}
+
+void Jacobian::evalRows(const double* theta, double* pos, double (*jac)[JACOB_MAX_DOF]) const {
+	double stack[JACOB_STACK_WORK];
+	std::vector<double> heap;
+	double *work = stack, *vals, *full;
+	int i, j, need;
+
+	if(use_chain && mode == JACOB_GEOMETRIC) {
+		chain.geometric(theta, deg_freedom, init_pos, pos, jac[0], JACOB_MAX_DOF);
+		pos[3] = 1;
+		return;
+	}
+	if(use_chain) {
+		chain.jacobian(theta, deg_freedom, init_pos, pos, jac[0], JACOB_MAX_DOF);
+		pos[3] = 1;
+		return;
+	}
+	if(mode == JACOB_REVERSE || mode == JACOB_FORWARD) {
+		need = (mode == JACOB_REVERSE ? trans_tape.reverseWorkSize() :
+			trans_tape.forwardWorkSize(deg_freedom)) + 4 * deg_freedom;
+		if(need > JACOB_STACK_WORK) {
+			heap.resize(need);
+			work = &heap[0];
+		}
+		full = work + need - 4 * deg_freedom;
+		if(mode == JACOB_REVERSE) {
+			trans_tape.jacobian(theta, deg_freedom, work, pos, full);
+		}
+		else {
+			trans_tape.forward(theta, deg_freedom, work, pos, full);
+		}
+		for(i = 0; i < 3; i++) {
+			for(j = 0; j < deg_freedom; j++) {
+				jac[i][j] = full[i * deg_freedom + j];
+			}
+		}
+		return;
+	}
+
+	need = jacob_tape.workSize() + jacob_tape.outputs();
+	if(need > JACOB_STACK_WORK) {
+		heap.resize(need);
+		work = &heap[0];
+	}
+	vals = work + need - jacob_tape.outputs();
+	if(mode == JACOB_COMPILED && compiled) {
+		compiled(theta, vals);
 	}
 	else {
-		finished = false;
+		jacob_tape.eval(theta, work, vals);
+	}
+	for(i = 0; i < 4; i++) {
+		pos[i] = vals[i];
 	}
+	//Only the packed entries are written, the rest is structurally zero
+	for(i = 0; i < 3; i++) {
+		for(j = 0; j < deg_freedom; j++) {
+			jac[i][j] = 0;
+		}
+	}
+	for(i = 0; i < (int)entry.size(); i++) {
+		jac[entry[i].row][entry[i].col] = vals[4 + i];
+	}
+}
 
-	return cTheta + ret * distance;
+double Jacobian::posError(const double* theta, const double* target) const {
+	double stack[JACOB_STACK_WORK];
+	std::vector<double> heap;
+	double *work = stack, pos[4], ret = 0;
+	int i;
+	if(use_chain) {
+		chain.eval(theta, init_pos, pos);
+	}
+	else {
+		if(trans_tape.workSize() > JACOB_STACK_WORK) {
+			heap.resize(trans_tape.workSize());
+			work = &heap[0];
+		}
+		trans_tape.eval(theta, work, pos);
+	}
+	for(i = 0; i < 3; i++) {
+		ret += (pos[i] - target[i]) * (pos[i] - target[i]);
+	}
+	return ret;
 }
 
-RealVec Jacobian::evalTrans(const RealVec& theta){
-	RealVec ret(4);
+void Jacobian::evalJacobian(const RealVec& theta, RealVec& pos, RealMat& jac) const {
 	int i;
+	switch(mode) {
+	case JACOB_REVERSE:
+		trans_tape.jacobian(theta, &pos[0], jac[0]);
+		break;
+	case JACOB_FORWARD:
+		trans_tape.forward(theta, &pos[0], jac[0]);
+		break;
+	default:
+		evalRows(theta, pos, jac);
+		for(i = 0; i < deg_freedom; i++) {
+			jac[3][i] = 0;
+		}
+		break;
+	}
+}
+
+void Jacobian::evalJacobian(const double* theta, double* pos, double (*jac)[JACOB_MAX_DOF]) const {
 	assert(state == READY);
+	evalRows(theta, pos, jac);
+}
+
+int Jacobian::jointFrames(const double* theta, double* pos, double (*axis)[3], double (*org)[3], int* var) const {
+	assert(state == READY && !hand_trans && chain.size() <= CHAIN_MAX_LINKS);
+	return chain.frames(theta, deg_freedom, init_pos, pos, NULL, axis, org, var);
+}
+
+void Jacobian::evalRows(const RealVec& theta, RealVec& pos, RealMat& jac) const {
+	RealVec vals;
+	RealMat full;
+	int i;
+	if(use_chain && mode == JACOB_GEOMETRIC) {
+		chain.geometric(&theta[0], deg_freedom, init_pos, &pos[0], jac[0], deg_freedom);
+		pos[3] = 1;
+		return;
+	}
+	if(use_chain) {
+		chain.jacobian(&theta[0], deg_freedom, init_pos, &pos[0], jac[0], deg_freedom);
+		pos[3] = 1;
+		return;
+	}
+	if(mode == JACOB_REVERSE || mode == JACOB_FORWARD) {
+		full = RealMat(deg_freedom, 4);
+		evalJacobian(theta, pos, full);
+		memcpy(jac[0], full[0], sizeof(double) * 3 * deg_freedom);
+		return;
+	}
+
+	vals = RealVec(4 + (int)entry.size());
+	if(mode == JACOB_COMPILED && compiled) {
+		compiled(&theta[0], &vals[0]);
+	}
+	else {
+		jacob_tape.eval(theta, &vals[0]);
+	}
 	for(i = 0; i < 4; i++) {
-		ret[i] = Refined[i](theta);
+		pos[i] = vals[i];
+	}
+	//Only the packed entries are written, the rest is structurally zero
+	memset(jac[0], 0, sizeof(double) * 3 * deg_freedom);
+	for(i = 0; i < (int)entry.size(); i++) {
+		jac[entry[i].row][entry[i].col] = vals[4 + i];
+	}
+}
+
+const std::vector<JacobEntry>& Jacobian::entries() const {
+	return entry;
+}
+
+double Jacobian::evalHessian(const RealVec& theta, const RealVec& target, RealVec& grad, RealMat& hess, bool full) const {
+	std::vector<double> vals(hess_tape.outputs() + 1);
+	const double* d = &vals[4];
+	double r[3], v, err = 0;
+	int i, j;
+	assert(state == READY && hessian);
+
+	hess_tape.eval(theta, &vals[0]);
+	for(i = 0; i < 3; i++) {
+		r[i] = vals[i] - target[i];
+		err += r[i] * r[i];
+	}
+	grad = RealVec(deg_freedom);
+	hess = RealMat(deg_freedom, deg_freedom);
+	for(i = 0; i < deg_freedom; i++) {
+		grad[i] = 0;
+		for(j = 0; j < deg_freedom; j++) {
+			hess[i][j] = 0;
+		}
+	}
+
+	//J^T r and J^T J from the packed partials
+	for(i = 0; i < (int)entry.size(); i++) {
+		grad[entry[i].col] += d[i] * r[entry[i].row];
+		for(j = 0; j < (int)entry.size(); j++) {
+			if(entry[j].row == entry[i].row) {
+				hess[entry[i].col][entry[j].col] += d[i] * d[j];
+			}
+		}
+	}
+	//plus the residuals times the second partials
+	d += entry.size();
+	for(i = 0; i < (int)hentry.size() && full; i++) {
+		v = r[hentry[i].row] * d[i];
+		hess[hentry[i].a][hentry[i].b] += v;
+		if(hentry[i].a != hentry[i].b) {
+			hess[hentry[i].b][hentry[i].a] += v;
+		}
+	}
+	return 0.5 * err;
+}
+
+//Solves a x = b by Cholesky, false unless a is positive definite
+static bool cholSolve(const RealMat& a, const RealVec& b, RealVec& x) {
+	const int n = b.dim();
+	RealMat l(n, n);
+	double s;
+	int i, j, k;
+	for(i = 0; i < n; i++) {
+		for(j = 0; j <= i; j++) {
+			s = a[i][j];
+			for(k = 0; k < j; k++) {
+				s -= l[i][k] * l[j][k];
+			}
+			if(i == j) {
+				if(s <= CALC_EPS * CALC_EPS) {
+					return false;
+				}
+				l[i][i] = sqrt(s);
+			}
+			else {
+				l[i][j] = s / l[j][j];
+			}
+		}
+	}
+	x = RealVec(n);
+	for(i = 0; i < n; i++) {
+		s = b[i];
+		for(k = 0; k < i; k++) {
+			s -= l[i][k] * x[k];
+		}
+		x[i] = s / l[i][i];
+	}
+	for(i = n - 1; i >= 0; i--) {
+		s = x[i];
+		for(k = i + 1; k < n; k++) {
+			s -= l[k][i] * x[k];
+		}
+		x[i] = s / l[i][i];
+	}
+	return true;
+}
+
+RealVec Jacobian::newtonStep(const RealVec& cTheta, const RealVec& desPos, bool& finished) const {
+	RealVec grad, step, next(deg_freedom), pos(4);
+	RealMat hess;
+	double err, e, alpha, mu, l;
+	int i, tries;
+
+	err = evalHessian(cTheta, desPos, grad, hess, true);
+	grad = grad * -1.0;
+	if(!cholSolve(hess, grad, step)) {
+		//Away from the solution the full Hessian can be indefinite, and
+		//J^T J singular at a stretched leg, damp until it solves. A NaN
+		//or infinite Hessian never does, so give up like stepDelta.
+		evalHessian(cTheta, desPos, grad, hess, false);
+		grad = grad * -1.0;
+		for(tries = 0, mu = 1e-6; !cholSolve(hess, grad, step); tries++, mu *= 10) {
+			if(tries == JACOB_LM_TRIES) {
+				finished = true;
+				return cTheta;
+			}
+			for(i = 0; i < deg_freedom; i++) {
+				hess[i][i] += mu;
+			}
+		}
+	}
+
+	//Newton steps far from the solution can leap across the limits,
+	//keep them within a trust radius and backtrack until the error drops
+	l = step.modulus();
+	if(l > JACOB_NEWTON_RADIUS) {
+		step = step * (JACOB_NEWTON_RADIUS / l);
+	}
+	for(alpha = 1; alpha > 1e-3; alpha *= 0.5) {
+		for(i = 0; i < deg_freedom; i++) {
+			next[i] = cTheta[i] + alpha * step[i];
+			if(next[i] > (*max_constraint)[i]) {
+				next[i] = (*max_constraint)[i];
+			}
+			if(next[i] < (*min_constraint)[i]) {
+				next[i] = (*min_constraint)[i];
+			}
+		}
+		evalTrans(next, &pos[0]);
+		e = 0;
+		for(i = 0; i < 3; i++) {
+			e += 0.5 * (pos[i] - desPos[i]) * (pos[i] - desPos[i]);
+		}
+		if(e < err) {
+			finished = RealVec(next - cTheta).modulus() <= CALC_EPS;
+			return next;
+		}
+	}
+	finished = true;
+	return cTheta;
+}
+
+//Squared distance from target to the end position enclosure over box
+double Jacobian::boxGap(const Interval* box, const RealVec& target, Interval* regs) const {
+	Interval pos[4];
+	double g, ret = 0;
+	int i;
+	if(use_chain) {
+		chain.evalInterval(box, init_pos, pos);
+	}
+	else {
+		trans_tape.evalInterval(box, regs, pos);
+	}
+	for(i = 0; i < 3; i++) {
+		g = 0;
+		if(target[i] < pos[i].lo) {
+			g = pos[i].lo - target[i];
+		}
+		else if(target[i] > pos[i].hi) {
+			g = target[i] - pos[i].hi;
+		}
+		ret += g * g;
 	}
 	return ret;
 }
+
+bool Jacobian::reachable(const RealVec& target, double tol, RealVec* seed) const {
+	std::vector<Interval> stack, box(deg_freedom), half[2];
+	std::vector<Interval> regs(trans_tape.size() + 1);
+	double gap[2], m;
+	int boxes = 1, i, k, w;
+	assert(state == READY);
+
+	for(i = 0; i < deg_freedom; i++) {
+		box[i] = Interval((*min_constraint)[i], (*max_constraint)[i]);
+	}
+	if(boxGap(&box[0], target, &regs[0]) > tol * tol) {
+		return false;
+	}
+	//Depth first, the half closer to the target is searched first
+	stack = box;
+	while(!stack.empty()) {
+		box.assign(stack.end() - deg_freedom, stack.end());
+		stack.resize(stack.size() - deg_freedom);
+		w = 0;
+		for(i = 1; i < deg_freedom; i++) {
+			if(box[i].width() > box[w].width()) {
+				w = i;
+			}
+		}
+		if(box[w].width() < JACOB_BOX_MIN || boxes >= JACOB_BOX_BUDGET) {
+			if(seed) {
+				*seed = RealVec(deg_freedom);
+				for(i = 0; i < deg_freedom; i++) {
+					(*seed)[i] = box[i].mid();
+				}
+			}
+			return true;
+		}
+		m = box[w].mid();
+		for(k = 0; k < 2; k++) {
+			half[k] = box;
+			half[k][w] = k ? Interval(m, box[w].hi) : Interval(box[w].lo, m);
+			gap[k] = boxGap(&half[k][0], target, &regs[0]);
+			boxes++;
+		}
+		k = gap[0] < gap[1];
+		if(gap[k] <= tol * tol) {
+			stack.insert(stack.end(), half[k].begin(), half[k].end());
+		}
+		if(gap[1 - k] <= tol * tol) {
+			stack.insert(stack.end(), half[1 - k].begin(), half[1 - k].end());
+		}
+	}
+	return false;
+}
+
+void Jacobian::nodeStats(int& before, int& after) const {
+	before = nodes_before;
+	after = nodes_after;
+}
+
+RealVec Jacobian::evalTrans(const RealVec& theta){
+	RealVec ret(4);
+	assert(state == READY);
+	if(use_chain) {
+		evalTrans(theta, &ret[0]);
+	}
+	else {
+		trans_state.eval(trans_tape, theta, &ret[0]);
+	}
+	return ret;
+}
+
+void Jacobian::evalTrans(const RealVec& theta, double* pos) const {
+	assert(state == READY);
+	if(use_chain) {
+		chain.eval(&theta[0], init_pos, pos);
+		pos[3] = 1;
+	}
+	else {
+		trans_tape.eval(theta, pos);
+	}
+}
+
+void Jacobian::evalTransBatch(const double* const* theta, int n, double* const* pos) const {
+	double t[JACOB_MAX_DOF], p[3];
+	int i, k;
+	assert(state == READY);
+	if(!use_chain) {
+		trans_tape.evalBatch(theta, n, pos);
+		return;
+	}
+	assert(deg_freedom <= JACOB_MAX_DOF);
+	for(k = 0; k < n; k++) {
+		for(i = 0; i < deg_freedom; i++) {
+			t[i] = theta[i][k];
+		}
+		chain.eval(t, init_pos, p);
+		for(i = 0; i < 3; i++) {
+			pos[i][k] = p[i];
+		}
+		pos[3][k] = 1;
+	}
+}
+
+bool Jacobian::writeCpp(const char* path, const char* name) {
+	JacobMode old = mode;
+	FILE* f;
+	char macro[256];
+	int i;
+	for(i = 0; name[i] && i < 255; i++) {
+		macro[i] = toupper(name[i]);
+	}
+	macro[i] = 0;
+
+	if(mode != JACOB_SYMBOLIC && mode != JACOB_COMPILED) {
+		setMode(JACOB_SYMBOLIC);
+	}
+	preprocess();
+	//Binary, so the header comes out byte for byte the same everywhere
+	//and regenerating an unchanged chain leaves it untouched
+	if((f = fopen(path, "wb")) == NULL) {
+		setMode(old);
+		return false;
+	}
+	fprintf(f, "// Generated by Jacobian::writeCpp, do not edit.\n");
+	fprintf(f, "// out: homogeneous position (4), then the partials that are not\n");
+	fprintf(f, "// structurally zero, row major:");
+	for(i = 0; i < (int)entry.size(); i++) {
+		fprintf(f, "%s d%d/d%d", i % 8 ? "," : "\n//", entry[i].row, entry[i].col);
+	}
+	fprintf(f, "\n\n");
+	fprintf(f, "#ifndef __%s_GEN_HEADER__\n#define __%s_GEN_HEADER__\n\n", macro, macro);
+	fprintf(f, "#include <math.h>\n\n");
+	fprintf(f, "#define %s_DOF %d\n", macro, deg_freedom);
+	fprintf(f, "#define %s_PARTIALS %d\n", macro, (int)entry.size());
+	fprintf(f, "#define %s_HASH 0x%08xu\n\n", macro, jacob_tape.hash());
+	jacob_tape.writeCpp(f, name);
+	fprintf(f, "\n#endif\n");
+	fclose(f);
+	setMode(old);
+	return true;
+}
@@ -4,16 +4,80 @@
 #include "linearalgebra.h"
 #include "euclid.h"
 #include "mathfunc.h"
+#include "tape.h"
+#include "chain.h"
+#include <string>
+#include <vector>
 
 using namespace MathFunc;
 using Linear::RealMat;
 using Linear::RealVec;
 
+//Largest chain stepDelta handles with fixed size matrices
+#define JACOB_MAX_DOF (64)
+//Tape work memory kept on the stack, larger tapes fall back to the heap
+#define JACOB_STACK_WORK (2048)
+
+//reachable() stops splitting below this joint range, in radians
+#define JACOB_BOX_MIN (0.02)
+//and gives up after evaluating this many boxes
+#define JACOB_BOX_BUDGET (4096)
+
 enum JacobState {
 	NOT_INIT = 0,
 	READY
 };
 
+//How stepDelta obtains the Jacobian
+enum JacobMode {
+	//Symbolic partials compiled with the position
+	JACOB_SYMBOLIC = 0,
+	//Reverse mode AD over the position tape, no partials are stored
+	JACOB_REVERSE,
+	//Forward mode AD, all columns carried along with the value
+	JACOB_FORWARD,
+	//Straight-line C++ generated by writeCpp and compiled in
+	JACOB_COMPILED,
+	//Links from pushRotV/pushRotC/pushTransC evaluated numerically.
+	//Chains entered with setTrans, or with useHessian, are treated as
+	//JACOB_SYMBOLIC.
+	JACOB_CHAIN,
+	//Like JACOB_CHAIN, but each column is axis x (end - joint) from the
+	//world frames of one forward pass, the default
+	JACOB_GEOMETRIC
+};
+
+//Structurally nonzero partial d position[row] / d theta[col]
+struct JacobEntry {
+	int row, col;
+};
+
+//Structurally nonzero second partial d2 position[row] / d theta[a] d theta[b], a <= b
+struct HessEntry {
+	int row, a, b;
+};
+
+//Outcome of Jacobian::solve
+struct JacobSolve {
+	//Last joint values, within the constraints
+	RealVec theta;
+	//Distance from the end to the target at theta
+	double error;
+	int iters;
+	//Wall time spent, in milliseconds
+	double ms;
+	//error is within the tolerance
+	bool converged;
+	//The step vanished first, e.g. against the joint limits
+	bool stalled;
+	//Stopped by the time budget
+	bool timedOut;
+};
+
+//Generated evaluator: out receives the homogeneous position (4), then
+//the structurally nonzero partials in row major order
+typedef void (*JacobFunc)(const double* theta, double* out);
+
 class Jacobian {
 public:
 	Jacobian();
@@ -27,28 +91,150 @@ public:
 	//void pushTransV();
 	void pushTransC(double x, double y, double z);
 	void setConstraint(int varid, double min, double max);
+	void getConstraint(int varid, double& min, double& max) const;
+	int dof() const;
 
+	//Enters the composed transformation directly, the pushed links are
+	//folded into it and the Jacobian becomes symbolic only
 	void setTrans(int i, int j, const ExprP& e);
+	void setMode(JacobMode m);
+	//Switches to JACOB_COMPILED. hash is the one writeCpp recorded, the
+	//generated code is only used while it matches the current chain.
+	void setCompiled(JacobFunc f, unsigned int hash);
+	//Simplified position and partials are kept in this file, keyed by
+	//the content of the chain, and reused by preprocess while it is
+	//unchanged. An empty path disables the cache.
+	void setCache(const char* path);
+	//Also derive second partials in preprocess, for evalHessian and
+	//newtonStep
+	void useHessian(bool on);
+	//stepDelta keeps joints at their limits out of the step instead of
+	//clamping them afterwards, and moves redundant joints towards the
+	//middle of their limits without moving the end. Off by default.
+	void useNullSpace(bool on);
 	
 	void preprocess();
 
-	RealVec stepDelta(const RealVec& cTheta, const RealVec& desPos, double distance, bool &finished);
+	//After preprocess the const members below only read the chain, and
+	//may be called for one Jacobian from several threads at once
+	RealVec stepDelta(const RealVec& cTheta, const RealVec& desPos, double distance, bool &finished) const;
+	//Damped least squares, J^T (J J^T + mu I)^-1 e, with mu raised until
+	//the error drops. Fixed size and on the stack, next receives DOF
+	//joint values.
+	void stepDelta(const double* cTheta, const double* desPos, double distance, double* next, bool& finished) const;
+	//Repeats stepDelta from initialTheta until the end is within
+	//tolerance of target, the step vanishes, maxIters steps are taken or
+	//timeBudget milliseconds have passed. A budget <= 0 means no limit.
+	//step is the stepDelta distance; 0 uses the interactive schedule of
+	//short steps first, for starts that may be far from target.
+	JacobSolve solve(const RealVec& target, const RealVec& initialTheta, double tolerance, int maxIters, double timeBudget, double step = 0) const;
+
+	//Orientation goals need the chain as pushed links, not setTrans.
+	//End position and 3 x 3 rotation at theta
+	void evalPose(const RealVec& theta, RealVec& pos, RealMat& rot) const;
+	//stepDelta with the end rotation also driven towards desRot (3 x 3
+	//row major). The residual is the position error stacked on the
+	//axis-angle error times rotWeight, both in the damped least squares.
+	void stepPose(const double* cTheta, const double* desPos, const double* desRot, double rotWeight, double distance, double* next, bool& finished) const;
+	//solve on that residual, tolerance bounds its norm
+	JacobSolve solvePose(const RealVec& target, const RealMat& rot, double rotWeight, const RealVec& initialTheta, double tolerance, int maxIters, double timeBudget, double step = 0) const;
 	
+	//Only recomputes the terms of the joints that moved since the last
+	//call. Keeps that state in the Jacobian, so not for concurrent use.
+	//Only the modes with a symbolic position tape evaluate incrementally,
+	//the links of JACOB_CHAIN and JACOB_GEOMETRIC are always evaluated in full.
 	RealVec evalTrans(const RealVec& theta);
+	//Homogeneous position into pos[4], without the cached state
+	void evalTrans(const RealVec& theta, double* pos) const;
+	//Positions of n joint vectors at once, see Tape::evalBatch
+	void evalTransBatch(const double* const* theta, int n, double* const* pos) const;
+
+	//Expression nodes of position and partials before/after simplification
+	void nodeStats(int& before, int& after) const;
+
+	//Generates a header with the position and Jacobian as one inline
+	//function, for use with setCompiled
+	bool writeCpp(const char* path, const char* name);
+
+	//Interval search over the joint limits: false only when no joint
+	//vector within them brings the end within tol of target. seed, if
+	//not NULL, receives the centre of a small box that was not ruled
+	//out. Gives up, returning true, after JACOB_BOX_BUDGET boxes.
+	bool reachable(const RealVec& target, double tol, RealVec* seed) const;
+
+	//Homogeneous end position and its 4 x DOF Jacobian at theta
+	void evalJacobian(const RealVec& theta, RealVec& pos, RealMat& jac) const;
+	//Same without allocating: pos[4] and the x, y, z rows into jac
+	void evalJacobian(const double* theta, double* pos, double (*jac)[JACOB_MAX_DOF]) const;
+	//Squared distance of the end from target
+	double posError(const double* theta, const double* target) const;
+	//Chain::frames of the pushed links at theta, end position into
+	//pos[3]. Not for chains entered with setTrans.
+	int jointFrames(const double* theta, double* pos, double (*axis)[3], double (*org)[3], int* var) const;
+
+	//Partials that are not structurally zero, in the order generated
+	//code and the Jacobian tape produce them
+	const std::vector<JacobEntry>& entries() const;
+
+	//Squared error 1/2 |p - target|^2 over x, y, z at theta, with its
+	//gradient (DOF) and Hessian (DOF x DOF). Without full only the
+	//Gauss-Newton part J^T J is formed. Needs useHessian.
+	double evalHessian(const RealVec& theta, const RealVec& target, RealVec& grad, RealMat& hess, bool full) const;
+	//Newton step on the squared error, Gauss-Newton where the Hessian
+	//is not positive definite, halved until the error drops and kept
+	//within the constraints
+	RealVec newtonStep(const RealVec& cTheta, const RealVec& desPos, bool& finished) const;
 
 private:
+	unsigned int chainKey(int order) const;
+	void derive(int order, std::vector<ExprP>& all);
+	void dropZeros(std::vector<ExprP>& all);
+	//Position and the x, y, z rows of the Jacobian, a DOF x 3 matrix
+	void evalRows(const RealVec& theta, RealVec& pos, RealMat& jac) const;
+	//Same without allocating, jac has JACOB_MAX_DOF columns
+	void evalRows(const double* theta, double* pos, double (*jac)[JACOB_MAX_DOF]) const;
+	void limitStep(const double* cTheta, double* ret, double distance, double* next) const;
+	void activeStep(const double* cTheta, const double (*jac)[JACOB_MAX_DOF], const double* e, double mu, double distance, double* ret, double* next) const;
+	void poseResidual(const double* theta, const double* desPos, const double* desRot, double rotWeight, double* jac, double* e) const;
+	double poseError(const double* theta, const double* desPos, const double* desRot, double rotWeight) const;
+	JacobSolve iterate(const double* desPos, const double* desRot, double rotWeight, const RealVec& initialTheta, double tolerance, int maxIters, double timeBudget, double step) const;
+	double boxGap(const Interval* box, const RealVec& target, Interval* regs) const;
+	bool loadCache(unsigned int key, std::vector<ExprP>& all);
+	void saveCache(unsigned int key, const std::vector<ExprP>& all) const;
 	
 	Linear::Vec<ExprP> initPos;
+	double init_pos[3];
+	//Links as pushed, unless hand_trans
+	Chain chain;
+	bool hand_trans;
+	//Set by preprocess when the chain is evaluated numerically
+	bool use_chain;
 	Linear::Vec<ExprP> Refined;
 
 	Linear::Mat<ExprP> rawTrans;
-	Linear::Mat<ExprP>* Jacob;
+	//Packed Jacobian, one partial per entry
+	std::vector<ExprP> Jacob;
+	std::vector<JacobEntry> entry;
+	//Second partials, positions and partials are compiled with them
+	std::vector<ExprP> Hess;
+	std::vector<HessEntry> hentry;
+	bool hessian;
+	bool null_space;
+	Tape trans_tape, jacob_tape, hess_tape;
+	//Previous evaluation, so a single moved joint is cheap to redo
+	TapeState trans_state;
+	JacobFunc compiled;
+	unsigned int compiled_hash;
+	std::string cache_path;
 	int deg_freedom;
 
 	RealVec* max_constraint;
 	RealVec* min_constraint;
+
+	int nodes_before, nodes_after;
 	
 	JacobState state;
+	JacobMode mode;
 };
 
 #endif
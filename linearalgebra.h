@@ -17,9 +17,9 @@ namespace Linear{
 	template<typename T>
 	class Vec {
 	public:
-		Vec(): dimension(0), data(NULL) {}
-		Vec(int dim): dimension(dim), data(new T[dim]) {}
-		Vec(const Vec& v): dimension(v.dimension), data(new T[v.dimension]) {
+		Vec(): data(NULL), dimension(0) {}
+		Vec(int dim): data(new T[dim]), dimension(dim) {}
+		Vec(const Vec& v): data(new T[v.dimension]), dimension(v.dimension) {
 			int i;
 			for(i = 0; i < dimension; i++) {
 				data[i] = v.data[i];
@@ -37,6 +37,22 @@ namespace Linear{
 			}
 			return *this;
 		}
+		Vec(Vec&& v): data(v.data), dimension(v.dimension) {
+			v.dimension = 0;
+			v.data = NULL;
+		}
+		Vec& operator=(Vec&& v) {
+			if(this != &v) {
+				if(data) {
+					delete [] data;
+				}
+				dimension = v.dimension;
+				data = v.data;
+				v.dimension = 0;
+				v.data = NULL;
+			}
+			return *this;
+		}
 		~Vec() {
 			if(data) {
 				delete [] data;
@@ -169,6 +185,10 @@ namespace Linear{
 				data[i] = mm.data[i];
 			}
 		}
+		Mat(Mat&& mm): m(mm.m), n(mm.n), data(mm.data) {
+			mm.m = mm.n = 0;
+			mm.data = NULL;
+		}
 
 		~Mat() {
 			if(data) {
@@ -189,6 +209,19 @@ namespace Linear{
 			return (*this);
 		}
 
+		Mat& operator=(Mat&& mm) {
+			if(this != &mm) {
+				if(data) {
+					delete [] data;
+				}
+				m = mm.m; n = mm.n;
+				data = mm.data;
+				mm.m = mm.n = 0;
+				mm.data = NULL;
+			}
+			return (*this);
+		}
+
 		T* operator[](const int idx) {
 			return data + m * idx;
 		}
@@ -214,11 +247,7 @@ namespace Linear{
 		}
 
 		Mat& operator*=(const Mat& mm) {
-			int i;
-			Mat r = (*this) * mm;
-			for(i = 0; i < m * n; i++) {
-				data[i] = r.data[i];
-			}
+			(*this) = (*this) * mm;
 			return (*this);
 		}
 
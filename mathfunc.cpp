@@ -1,90 +1,227 @@
 #include "mathfunc.h"
 #include <math.h>
+#include <string.h>
+#include <unordered_set>
+#include <unordered_map>
+#include <vector>
+#include <utility>
+#include <new>
+#include <stdlib.h>
+#include <mutex>
 
 using namespace MathFunc;
 
+static size_t hashMix(size_t h, size_t v) {
+	return h ^ (v + 0x9e3779b9 + (h << 6) + (h >> 2));
+}
+
+//Hash-consing table of every live expression node
+struct ExprHash {
+	size_t operator()(const Expr* e) const {
+		return e->hash();
+	}
+};
+struct ExprSame {
+	bool operator()(const Expr* a, const Expr* b) const {
+		return a->type() == b->type() && a->same(*b);
+	}
+};
+typedef std::unordered_set<const Expr*, ExprHash, ExprSame> ExprPool;
+
+//Recursive, destroying a node releases its operands
+struct ExprTable {
+	ExprPool nodes;
+	std::recursive_mutex lock;
+};
+
+//Never destroyed, static ExprP objects may outlive it otherwise
+static ExprTable& table() {
+	static ExprTable* t = new ExprTable();
+	return *t;
+}
+
+//Node allocator: one free list per 8 byte size class, refilled a chunk
+//at a time. Nodes are recycled, so rebuilding a graph does not go back
+//to the heap.
+#define NODE_CLASSES 8
+#define NODE_CHUNK 512
+
+static void* free_nodes[NODE_CLASSES];
+static std::mutex& nodeLock() {
+	static std::mutex* m = new std::mutex();
+	return *m;
+}
+
+static void refillNodes(size_t cls) {
+	size_t size = cls * 8;
+	char* chunk = (char*)malloc(size * NODE_CHUNK);
+	int i;
+	if(!chunk) {
+		throw std::bad_alloc();
+	}
+	for(i = 0; i < NODE_CHUNK; i++) {
+		*(void**)(chunk + i * size) = free_nodes[cls];
+		free_nodes[cls] = chunk + i * size;
+	}
+}
+
+void* Expr::operator new(size_t size) {
+	size_t cls = (size + 7) / 8;
+	void* p;
+	if(cls >= NODE_CLASSES) {
+		return ::operator new(size);
+	}
+	std::lock_guard<std::mutex> guard(nodeLock());
+	if(!free_nodes[cls]) {
+		refillNodes(cls);
+	}
+	p = free_nodes[cls];
+	free_nodes[cls] = *(void**)p;
+	return p;
+}
+
+void Expr::operator delete(void* p, size_t size) {
+	size_t cls = (size + 7) / 8;
+	if(!p) {
+		return;
+	}
+	if(cls >= NODE_CLASSES) {
+		::operator delete(p);
+		return;
+	}
+	std::lock_guard<std::mutex> guard(nodeLock());
+	*(void**)p = free_nodes[cls];
+	free_nodes[cls] = p;
+}
+
+Expr::Expr(): ref(0) {}
 Expr::~Expr() {}
 double Expr::operator()(const RealVec& v) const {
 	return this->eval(v);
 }
 
+const Expr* ExprP::intern(const Expr& e, Expr* owned) {
+	ExprTable& t = table();
+	std::lock_guard<std::recursive_mutex> guard(t.lock);
+	ExprPool& p = t.nodes;
+	ExprPool::iterator it = p.find(&e);
+	const Expr* ret;
+	if(it != p.end()) {
+		if(owned) {
+			delete owned;
+		}
+		ret = *it;
+	}
+	else {
+		ret = owned ? owned : e.nSelf();
+		p.insert(ret);
+	}
+	ret->ref++;
+	return ret;
+}
+
+void ExprP::release(const Expr* e) {
+	int r;
+	if(!e) {
+		return;
+	}
+	//Fast path while other references remain
+	r = e->ref.load();
+	while(r > 1) {
+		if(e->ref.compare_exchange_weak(r, r - 1)) {
+			return;
+		}
+	}
+	std::lock_guard<std::recursive_mutex> guard(table().lock);
+	if(--e->ref == 0) {
+		table().nodes.erase(e);
+		delete e;
+	}
+}
+
+int ExprP::poolSize() {
+	std::lock_guard<std::recursive_mutex> guard(table().lock);
+	return (int)table().nodes.size();
+}
+
 ExprP::ExprP(): expr(NULL) {}
-ExprP::ExprP(const Expr& e): expr(e.nSelf()) {}
-ExprP::ExprP(const ExprP& e): expr(e.expr->nSelf()) {}
-ExprP::ExprP(Expr* e): expr(e) {}
-ExprP::~ExprP() {
+ExprP::ExprP(const Expr& e): expr(intern(e, NULL)) {}
+ExprP::ExprP(const ExprP& e): expr(e.expr) {
 	if(expr) {
-		delete expr;
+		expr->ref++;
 	}
 }
+ExprP::ExprP(ExprP&& e): expr(e.expr) {
+	e.expr = NULL;
+}
+ExprP::ExprP(Expr* e): expr(intern(*e, e)) {}
+ExprP::~ExprP() {
+	release(expr);
+}
 
 ExprP& ExprP::operator=(const ExprP& e) {
-	if(expr) {
-		delete expr;
+	if(e.expr) {
+		e.expr->ref++;
 	}
-	expr = e.expr->nSelf();
+	release(expr);
+	expr = e.expr;
 	return (*this);
 }
 
-ExprP& ExprP::operator=(const Expr& e) {
-	if(expr) {
-		delete expr;
+ExprP& ExprP::operator=(ExprP&& e) {
+	if(this != &e) {
+		release(expr);
+		expr = e.expr;
+		e.expr = NULL;
 	}
-	expr = e.nSelf();
 	return (*this);
 }
 
-ExprP& ExprP::operator=(double scalar) {
-	if(expr) {
-		delete expr;
-	}
-	expr = new ConstFunc(scalar);
+ExprP& ExprP::operator=(const Expr& e) {
+	const Expr* n = intern(e, NULL);
+	release(expr);
+	expr = n;
 	return (*this);
 }
 
+ExprP& ExprP::operator=(double scalar) {
+	return (*this) = ConstFunc(scalar);
+}
+
 ExprP& ExprP::operator+=(const ExprP& e) {
-	expr = new Add(expr, e.expr->nSelf());
-	return (*this);
+	return (*this) = Add(std::move(*this), ExprP(e));
 }
 
 ExprP& ExprP::operator+=(const Expr& e) {
-	expr = new Add(expr, e.nSelf());
-	return (*this);
+	return (*this) = Add(std::move(*this), ExprP(e));
 }
 
 ExprP& ExprP::operator+=(double scalar) {
-	expr = new Add(expr, new ConstFunc(scalar));
-	return (*this);
+	return (*this) = Add(std::move(*this), ExprP(ConstFunc(scalar)));
 }
 
 ExprP& ExprP::operator*=(const ExprP& e) {
-	expr = new Mult(expr, e.expr->nSelf());
-	return (*this);
+	return (*this) = Mult(std::move(*this), ExprP(e));
 }
 
 ExprP& ExprP::operator*=(const Expr& e) {
-	expr = new Mult(expr, e.nSelf());
-	return (*this);
+	return (*this) = Mult(std::move(*this), ExprP(e));
 }
 
 ExprP& ExprP::operator*=(double scalar) {
-	expr = new Mult(expr, new ConstFunc(scalar));
-	return (*this);
+	return (*this) = Mult(std::move(*this), ExprP(ConstFunc(scalar)));
 }
 
 ExprP& ExprP::operator-=(const ExprP& e) {
-	expr = new Minus(expr, e.expr->nSelf());
-	return (*this);
+	return (*this) = Minus(std::move(*this), ExprP(e));
 }
 
 ExprP& ExprP::operator-=(const Expr& e) {
-	expr = new Minus(expr, e.nSelf());
-	return (*this);
+	return (*this) = Minus(std::move(*this), ExprP(e));
 }
 
 ExprP& ExprP::operator-=(double scalar) {
-	expr = new Minus(expr, new ConstFunc(scalar));
-	return (*this);
+	return (*this) = Minus(std::move(*this), ExprP(ConstFunc(scalar)));
 }
 
 double ExprP::eval(const RealVec& v) const {
@@ -96,7 +233,19 @@ double ExprP::operator()(const RealVec& v) const {
 }
 
 ExprP ExprP::pd(int idx) const {
-	return ExprP(expr->pd(idx));
+	return simplify(expr->pd(idx));
+}
+
+const Expr* ExprP::get() const {
+	return expr;
+}
+
+const Expr* ExprP::operator->() const {
+	return expr;
+}
+
+bool ExprP::null() const {
+	return expr == NULL;
 }
 
 ConstFunc::ConstFunc(): constant(0) {}
@@ -108,8 +257,29 @@ double ConstFunc::eval(const RealVec& v) const {
 Expr* ConstFunc::nSelf() const {
 	return new ConstFunc(constant);
 }
-Expr* ConstFunc::pd(int idx) const {
-	return new ConstFunc(0);
+ExprP ConstFunc::pd(int idx) const {
+	return ConstFunc(0);
+}
+ExprType ConstFunc::type() const {
+	return EXPR_CONST;
+}
+//Zeros of either sign are one constant, and so are all NaNs, which
+//would otherwise never match themselves and be interned anew each time
+size_t ConstFunc::hash() const {
+	double c = constant == 0 ? 0 : constant;
+	unsigned long long bits;
+	if(c != c) {
+		c = NAN;
+	}
+	memcpy(&bits, &c, sizeof(bits));
+	return hashMix(EXPR_CONST, (size_t)(bits ^ (bits >> 32)));
+}
+bool ConstFunc::same(const Expr& e) const {
+	double c = ((const ConstFunc&)e).constant;
+	return constant == c || (constant != constant && c != c);
+}
+double ConstFunc::value() const {
+	return constant;
 }
 
 VarFunc::VarFunc(): var_id(0) {}
@@ -119,15 +289,27 @@ double VarFunc::eval(const RealVec& v) const {
 	return this->eval(v[var_id]);
 }
 
-Expr* VarFunc::pd(int idx) const {
+ExprP VarFunc::pd(int idx) const {
 	if(var_id == idx) {
 		return this->d();
 	}
 	else {
-		return new ConstFunc(0);
+		return ConstFunc(0);
 	}
 }
 
+size_t VarFunc::hash() const {
+	return hashMix(this->type(), var_id);
+}
+
+bool VarFunc::same(const Expr& e) const {
+	return var_id == ((const VarFunc&)e).var_id;
+}
+
+int VarFunc::var() const {
+	return var_id;
+}
+
 SinFunc::SinFunc(): VarFunc() {}
 SinFunc::SinFunc(int id): VarFunc(id) {}
 
@@ -139,8 +321,12 @@ Expr* SinFunc::nSelf() const {
 	return new SinFunc(var_id);
 }
 
-Expr* SinFunc::d() const {
-	return new CosFunc(var_id);
+ExprP SinFunc::d() const {
+	return CosFunc(var_id);
+}
+
+ExprType SinFunc::type() const {
+	return EXPR_SIN;
 }
 
 CosFunc::CosFunc(): VarFunc() {}
@@ -154,8 +340,12 @@ Expr* CosFunc::nSelf() const {
 	return new CosFunc(var_id);
 }
 
-Expr* CosFunc::d() const {
-	return new unaryMinus(SinFunc(var_id));
+ExprP CosFunc::d() const {
+	return unaryMinus(SinFunc(var_id));
+}
+
+ExprType CosFunc::type() const {
+	return EXPR_COS;
 }
 
 
@@ -170,202 +360,537 @@ Expr* XFunc::nSelf() const {
 	return new XFunc(var_id);
 }
 
-Expr* XFunc::d() const {
-	return new ConstFunc(1.0);
+ExprP XFunc::d() const {
+	return ConstFunc(1.0);
 }
 
-Minus::Minus(): l(NULL), r(NULL) {}
-Minus::Minus(const Expr& a, const Expr& b): l(a.nSelf()), r(b.nSelf()) {}
-Minus::Minus(Expr* a, Expr* b): l(a), r(b) {}
-Minus::~Minus() {
-	if(l) {
-		delete l;
-	}
-	if(r) {
-		delete r;
-	}
+ExprType XFunc::type() const {
+	return EXPR_X;
+}
+
+BinaryFunc::BinaryFunc() {}
+BinaryFunc::BinaryFunc(const ExprP& a, const ExprP& b): l(a), r(b) {}
+BinaryFunc::BinaryFunc(ExprP&& a, ExprP&& b): l(std::move(a)), r(std::move(b)) {}
+
+size_t BinaryFunc::hash() const {
+	return hashMix(hashMix(this->type(), (size_t)l.get()), (size_t)r.get());
+}
+
+bool BinaryFunc::same(const Expr& e) const {
+	const BinaryFunc& b = (const BinaryFunc&)e;
+	return l.get() == b.l.get() && r.get() == b.r.get();
 }
 
+const ExprP& BinaryFunc::left() const {
+	return l;
+}
+
+const ExprP& BinaryFunc::right() const {
+	return r;
+}
+
+Minus::Minus() {}
+Minus::Minus(const ExprP& a, const ExprP& b): BinaryFunc(a, b) {}
+Minus::Minus(ExprP&& a, ExprP&& b): BinaryFunc(std::move(a), std::move(b)) {}
+
 double Minus::eval(const RealVec& v) const {
 	return l->eval(v) - r->eval(v);
 }
 
 Expr* Minus::nSelf() const {
-	return new Minus(*l, *r);
+	return new Minus(l, r);
 }
 
-Expr* Minus::pd(int idx) const {
-	return new Minus(l->pd(idx), r->pd(idx));
+ExprP Minus::pd(int idx) const {
+	return Minus(l->pd(idx), r->pd(idx));
 }
 
-Add::Add(): l(NULL), r(NULL) {}
-Add::Add(const Expr& a, const Expr& b): l(a.nSelf()), r(b.nSelf()) {}
-Add::Add(Expr* a, Expr* b): l(a), r(b) {}
-Add::~Add() {
-	if(l) {
-		delete l;
-	}
-	if(r) {
-		delete r;
-	}
+ExprType Minus::type() const {
+	return EXPR_MINUS;
 }
 
+Add::Add() {}
+Add::Add(const ExprP& a, const ExprP& b): BinaryFunc(a, b) {}
+Add::Add(ExprP&& a, ExprP&& b): BinaryFunc(std::move(a), std::move(b)) {}
+
 double Add::eval(const RealVec& v) const {
 	return l->eval(v) + r->eval(v);
 }
 
 Expr* Add::nSelf() const {
-	return new Add(*l, *r);
+	return new Add(l, r);
 }
 
-Expr* Add::pd(int idx) const {
-	return new Add(l->pd(idx), r->pd(idx));
+ExprP Add::pd(int idx) const {
+	return Add(l->pd(idx), r->pd(idx));
 }
 
-Mult::Mult(): l(NULL), r(NULL) {}
-Mult::Mult(const Expr& a, const Expr& b): l(a.nSelf()), r(b.nSelf()) {}
-Mult::Mult(Expr* a, Expr* b): l(a), r(b) {}
-Mult::~Mult() {
-	if(l) {
-		delete l;
-	}
-	if(r) {
-		delete r;
-	}
+ExprType Add::type() const {
+	return EXPR_ADD;
 }
 
+Mult::Mult() {}
+Mult::Mult(const ExprP& a, const ExprP& b): BinaryFunc(a, b) {}
+Mult::Mult(ExprP&& a, ExprP&& b): BinaryFunc(std::move(a), std::move(b)) {}
+
 double Mult::eval(const RealVec& v) const {
 	return l->eval(v) * r->eval(v);
 }
 
 Expr* Mult::nSelf() const {
-	return new Mult(*l, *r);
+	return new Mult(l, r);
 }
 
-Expr* Mult::pd(int idx) const {
-	Expr *pdl, *pdr, *ret;
-	pdl = l->pd(idx);
-	pdr = r->pd(idx);
-	ret = new Add(Mult(*pdl, *r), Mult(*l, *pdr));
-	delete pdl;
-	delete pdr;
-	return ret;
+ExprP Mult::pd(int idx) const {
+	return Add(Mult(l->pd(idx), r), Mult(l, r->pd(idx)));
 }
 
-
-unaryMinus::unaryMinus(): expr(NULL) {}
-unaryMinus::unaryMinus(const Expr& a): expr(a.nSelf()) {}
-unaryMinus::unaryMinus(Expr* a): expr(a) {}
-unaryMinus::~unaryMinus() {
-	if(expr) {
-		delete expr;
-	}
+ExprType Mult::type() const {
+	return EXPR_MULT;
 }
 
+
+unaryMinus::unaryMinus() {}
+unaryMinus::unaryMinus(const ExprP& a): expr(a) {}
+unaryMinus::unaryMinus(ExprP&& a): expr(std::move(a)) {}
+
 double unaryMinus::eval(const RealVec& v) const {
 	return -expr->eval(v);
 }
 
 Expr* unaryMinus::nSelf() const {
-	return new unaryMinus(*expr);
+	return new unaryMinus(expr);
+}
+
+ExprP unaryMinus::pd(int idx) const {
+	return unaryMinus(expr->pd(idx));
+}
+
+ExprType unaryMinus::type() const {
+	return EXPR_UMINUS;
+}
+
+size_t unaryMinus::hash() const {
+	return hashMix(EXPR_UMINUS, (size_t)expr.get());
+}
+
+bool unaryMinus::same(const Expr& e) const {
+	return expr.get() == ((const unaryMinus&)e).expr.get();
 }
 
-Expr* unaryMinus::pd(int idx) const {
-	return new unaryMinus(expr->pd(idx));
+const ExprP& unaryMinus::operand() const {
+	return expr;
 }
 
 //Operators
+//Every operator builds its node on the stack, ExprP only allocates
+//when no structurally equal node is alive yet.
 //ExprP x ExprP
 ExprP MathFunc::operator-(const ExprP& a, const ExprP& b) {
-	return ExprP(new Minus(*a.expr, *b.expr));
+	return Minus(a, b);
 }
 
 ExprP MathFunc::operator-(const ExprP& a) {
-	return ExprP(new unaryMinus(*a.expr));
+	return unaryMinus(a);
 }
 
 ExprP MathFunc::operator+(const ExprP& a, const ExprP& b) {
-	return ExprP(new Add(*a.expr, *b.expr));
+	return Add(a, b);
 }
 
 ExprP MathFunc::operator*(const ExprP& a, const ExprP& b) {
-	return ExprP(new Mult(*a.expr, *b.expr));
+	return Mult(a, b);
+}
+
+//Rvalue ExprP
+ExprP MathFunc::operator-(ExprP&& a, ExprP&& b) {
+	return Minus(std::move(a), std::move(b));
+}
+
+ExprP MathFunc::operator-(ExprP&& a) {
+	return unaryMinus(std::move(a));
+}
+
+ExprP MathFunc::operator+(ExprP&& a, ExprP&& b) {
+	return Add(std::move(a), std::move(b));
+}
+
+ExprP MathFunc::operator*(ExprP&& a, ExprP&& b) {
+	return Mult(std::move(a), std::move(b));
+}
+
+ExprP MathFunc::operator-(ExprP&& a, const ExprP& b) {
+	return Minus(std::move(a), ExprP(b));
+}
+ExprP MathFunc::operator-(const ExprP& a, ExprP&& b) {
+	return Minus(ExprP(a), std::move(b));
+}
+ExprP MathFunc::operator+(ExprP&& a, const ExprP& b) {
+	return Add(std::move(a), ExprP(b));
+}
+ExprP MathFunc::operator+(const ExprP& a, ExprP&& b) {
+	return Add(ExprP(a), std::move(b));
+}
+ExprP MathFunc::operator*(ExprP&& a, const ExprP& b) {
+	return Mult(std::move(a), ExprP(b));
+}
+ExprP MathFunc::operator*(const ExprP& a, ExprP&& b) {
+	return Mult(ExprP(a), std::move(b));
+}
+
+ExprP MathFunc::operator-(ExprP&& a, const Expr& b) {
+	return Minus(std::move(a), ExprP(b));
+}
+ExprP MathFunc::operator-(const Expr& a, ExprP&& b) {
+	return Minus(ExprP(a), std::move(b));
+}
+ExprP MathFunc::operator+(ExprP&& a, const Expr& b) {
+	return Add(std::move(a), ExprP(b));
+}
+ExprP MathFunc::operator+(const Expr& a, ExprP&& b) {
+	return Add(ExprP(a), std::move(b));
+}
+ExprP MathFunc::operator*(ExprP&& a, const Expr& b) {
+	return Mult(std::move(a), ExprP(b));
+}
+ExprP MathFunc::operator*(const Expr& a, ExprP&& b) {
+	return Mult(ExprP(a), std::move(b));
+}
+
+ExprP MathFunc::operator-(ExprP&& a, double b) {
+	return Minus(std::move(a), ExprP(ConstFunc(b)));
+}
+ExprP MathFunc::operator-(double a, ExprP&& b) {
+	return Minus(ExprP(ConstFunc(a)), std::move(b));
+}
+ExprP MathFunc::operator+(ExprP&& a, double b) {
+	return Add(std::move(a), ExprP(ConstFunc(b)));
+}
+ExprP MathFunc::operator+(double a, ExprP&& b) {
+	return Add(ExprP(ConstFunc(a)), std::move(b));
+}
+ExprP MathFunc::operator*(ExprP&& a, double b) {
+	return Mult(std::move(a), ExprP(ConstFunc(b)));
+}
+ExprP MathFunc::operator*(double a, ExprP&& b) {
+	return Mult(ExprP(ConstFunc(a)), std::move(b));
 }
 
 //Expr x Expr
 ExprP MathFunc::operator-(const Expr& a, const Expr& b) {
-	return ExprP(new Minus(a, b));
+	return Minus(a, b);
 }
 
 ExprP MathFunc::operator-(const Expr& a) {
-	return ExprP(new unaryMinus(a));
+	return unaryMinus(a);
 }
 
 ExprP MathFunc::operator+(const Expr& a, const Expr& b) {
-	return ExprP(new Add(a, b));
+	return Add(a, b);
 }
 
 ExprP MathFunc::operator*(const Expr& a, const Expr& b) {
-	return ExprP(new Mult(a, b));
+	return Mult(a, b);
 }
 
 //ExprP x Expr
 ExprP MathFunc::operator-(const ExprP& a, const Expr& b) {
-	return ExprP(new Minus(*a.expr, b));
+	return Minus(a, b);
 }
 ExprP MathFunc::operator-(const Expr& a, const ExprP& b) {
-	return ExprP(new Minus(a, *b.expr));
+	return Minus(a, b);
 }
 ExprP MathFunc::operator+(const ExprP& a, const Expr& b) {
-	return ExprP(new Add(*a.expr, b));
+	return Add(a, b);
 }
 ExprP MathFunc::operator+(const Expr& a, const ExprP& b) {
-	return ExprP(new Add(a, *b.expr));
+	return Add(a, b);
 }
 ExprP MathFunc::operator*(const ExprP& a, const Expr& b) {
-	return ExprP(new Mult(*a.expr, b));
+	return Mult(a, b);
 }
 ExprP MathFunc::operator*(const Expr& a, const ExprP& b) {
-	return ExprP(new Mult(a, *b.expr));
+	return Mult(a, b);
 }
 
 //Scalar
 //scalar x ExprP
 ExprP MathFunc::operator-(const ExprP& a, double b) {
-	return ExprP(new Minus(*a.expr, ConstFunc(b)));
+	return Minus(a, ConstFunc(b));
 }
 ExprP MathFunc::operator-(double a, const ExprP& b) {
-	return ExprP(new Minus(ConstFunc(a), *b.expr));
+	return Minus(ConstFunc(a), b);
 }
 ExprP MathFunc::operator+(const ExprP& a, double b) {
-	return ExprP(new Add(*a.expr, ConstFunc(b)));
+	return Add(a, ConstFunc(b));
 }
 ExprP MathFunc::operator+(double a, const ExprP& b) {
-	return ExprP(new Add(ConstFunc(a), *b.expr));
+	return Add(ConstFunc(a), b);
 }
 ExprP MathFunc::operator*(const ExprP& a, double b) {
-	return ExprP(new Mult(*a.expr, ConstFunc(b)));
+	return Mult(a, ConstFunc(b));
 }
 ExprP MathFunc::operator*(double a, const ExprP& b) {
-	return ExprP(new Mult(ConstFunc(a), *b.expr));
+	return Mult(ConstFunc(a), b);
 }
 
 //scalar x Expr
 ExprP MathFunc::operator-(const Expr& a, double b) {
-	return ExprP(new Minus(a, ConstFunc(b)));
+	return Minus(a, ConstFunc(b));
 }
 ExprP MathFunc::operator-(double a, const Expr& b) {
-	return ExprP(new Minus(ConstFunc(a), b));
+	return Minus(ConstFunc(a), b);
 }
 ExprP MathFunc::operator+(const Expr& a, double b) {
-	return ExprP(new Add(a, ConstFunc(b)));
+	return Add(a, ConstFunc(b));
 }
 ExprP MathFunc::operator+(double a, const Expr& b) {
-	return ExprP(new Add(ConstFunc(a), b));
+	return Add(ConstFunc(a), b);
 }
 ExprP MathFunc::operator*(const Expr& a, double b) {
-	return ExprP(new Mult(a, ConstFunc(b)));
+	return Mult(a, ConstFunc(b));
 }
 ExprP MathFunc::operator*(double a, const Expr& b) {
-	return ExprP(new Mult(ConstFunc(a), b));
+	return Mult(ConstFunc(a), b);
+}
+
+//Simplification
+typedef std::unordered_map<const Expr*, ExprP> SimplifyMemo;
+
+static bool isConst(const ExprP& e) {
+	return e->type() == EXPR_CONST;
+}
+
+static bool isConst(const ExprP& e, double c) {
+	return isConst(e) && ((const ConstFunc*)e.get())->value() == c;
+}
+
+static double constOf(const ExprP& e) {
+	return ((const ConstFunc*)e.get())->value();
+}
+
+static bool isNeg(const ExprP& e) {
+	return e->type() == EXPR_UMINUS;
+}
+
+static const ExprP& negOf(const ExprP& e) {
+	return ((const unaryMinus*)e.get())->operand();
+}
+
+static ExprP foldAdd(const ExprP& a, const ExprP& b);
+static ExprP foldMinus(const ExprP& a, const ExprP& b);
+static ExprP foldMult(const ExprP& a, const ExprP& b);
+
+static ExprP foldNeg(const ExprP& a) {
+	if(isConst(a)) {
+		return ConstFunc(-constOf(a));
+	}
+	if(isNeg(a)) {
+		return negOf(a);
+	}
+	if(a->type() == EXPR_MINUS) {
+		const Minus* m = (const Minus*)a.get();
+		return foldMinus(m->right(), m->left());
+	}
+	return unaryMinus(a);
+}
+
+static ExprP foldAdd(const ExprP& a, const ExprP& b) {
+	if(isConst(a) && isConst(b)) {
+		return ConstFunc(constOf(a) + constOf(b));
+	}
+	if(isConst(a, 0)) {
+		return b;
+	}
+	if(isConst(b, 0)) {
+		return a;
+	}
+	if(isNeg(b)) {
+		return foldMinus(a, negOf(b));
+	}
+	if(isNeg(a)) {
+		return foldMinus(b, negOf(a));
+	}
+	return Add(a, b);
+}
+
+static ExprP foldMinus(const ExprP& a, const ExprP& b) {
+	if(isConst(a) && isConst(b)) {
+		return ConstFunc(constOf(a) - constOf(b));
+	}
+	if(a.get() == b.get()) {
+		return ConstFunc(0);
+	}
+	if(isConst(b, 0)) {
+		return a;
+	}
+	if(isConst(a, 0)) {
+		return foldNeg(b);
+	}
+	if(isNeg(b)) {
+		return foldAdd(a, negOf(b));
+	}
+	if(isNeg(a)) {
+		return foldNeg(foldAdd(negOf(a), b));
+	}
+	return Minus(a, b);
+}
+
+static ExprP foldMult(const ExprP& a, const ExprP& b) {
+	if(isConst(a) && isConst(b)) {
+		return ConstFunc(constOf(a) * constOf(b));
+	}
+	//Keep constants on the left so c1 * (c2 * x) can be merged
+	if(isConst(b)) {
+		return foldMult(b, a);
+	}
+	if(isConst(a, 0)) {
+		return ConstFunc(0);
+	}
+	if(isConst(a, 1)) {
+		return b;
+	}
+	if(isConst(a, -1)) {
+		return foldNeg(b);
+	}
+	if(isNeg(a)) {
+		return foldNeg(foldMult(negOf(a), b));
+	}
+	if(isNeg(b)) {
+		return foldNeg(foldMult(a, negOf(b)));
+	}
+	if(isConst(a) && b->type() == EXPR_MULT) {
+		const Mult* m = (const Mult*)b.get();
+		if(isConst(m->left())) {
+			return foldMult(ConstFunc(constOf(a) * constOf(m->left())), m->right());
+		}
+	}
+	return Mult(a, b);
+}
+
+static ExprP simplifyNode(const ExprP& e, SimplifyMemo& memo) {
+	SimplifyMemo::iterator it = memo.find(e.get());
+	const BinaryFunc* b;
+	ExprP ret;
+	if(it != memo.end()) {
+		return it->second;
+	}
+	switch(e->type()) {
+	case EXPR_ADD:
+		b = (const BinaryFunc*)e.get();
+		ret = foldAdd(simplifyNode(b->left(), memo), simplifyNode(b->right(), memo));
+		break;
+	case EXPR_MINUS:
+		b = (const BinaryFunc*)e.get();
+		ret = foldMinus(simplifyNode(b->left(), memo), simplifyNode(b->right(), memo));
+		break;
+	case EXPR_MULT:
+		b = (const BinaryFunc*)e.get();
+		ret = foldMult(simplifyNode(b->left(), memo), simplifyNode(b->right(), memo));
+		break;
+	case EXPR_UMINUS:
+		ret = foldNeg(simplifyNode(negOf(e), memo));
+		break;
+	default:
+		ret = e;
+		break;
+	}
+	memo[e.get()] = ret;
+	return ret;
+}
+
+ExprP MathFunc::simplify(const ExprP& e) {
+	SimplifyMemo memo;
+	return simplifyNode(e, memo);
+}
+
+void MathFunc::simplify(ExprP* es, int n) {
+	SimplifyMemo memo;
+	int i;
+	for(i = 0; i < n; i++) {
+		es[i] = simplifyNode(es[i], memo);
+	}
+}
+
+int MathFunc::nodeCount(const ExprP& e) {
+	return nodeCount(&e, 1);
+}
+
+int MathFunc::nodeCount(const ExprP* es, int n) {
+	std::unordered_set<const Expr*> seen;
+	std::vector<const Expr*> stack;
+	const Expr* e;
+	int i;
+	for(i = 0; i < n; i++) {
+		stack.push_back(es[i].get());
+	}
+	while(!stack.empty()) {
+		e = stack.back();
+		stack.pop_back();
+		if(!seen.insert(e).second) {
+			continue;
+		}
+		switch(e->type()) {
+		case EXPR_ADD:
+		case EXPR_MINUS:
+		case EXPR_MULT:
+			stack.push_back(((const BinaryFunc*)e)->left().get());
+			stack.push_back(((const BinaryFunc*)e)->right().get());
+			break;
+		case EXPR_UMINUS:
+			stack.push_back(((const unaryMinus*)e)->operand().get());
+			break;
+		default:
+			break;
+		}
+	}
+	return (int)seen.size();
+}
+
+unsigned long long MathFunc::varBit(int var) {
+	return 1ULL << (var < VAR_MASK_BITS ? var : VAR_MASK_BITS - 1);
+}
+
+typedef std::unordered_map<const Expr*, unsigned long long> MaskMemo;
+
+static unsigned long long maskNode(const Expr* e, MaskMemo& memo) {
+	MaskMemo::iterator it = memo.find(e);
+	unsigned long long ret = 0;
+	if(it != memo.end()) {
+		return it->second;
+	}
+	switch(e->type()) {
+	case EXPR_SIN:
+	case EXPR_COS:
+	case EXPR_X:
+		ret = varBit(((const VarFunc*)e)->var());
+		break;
+	case EXPR_ADD:
+	case EXPR_MINUS:
+	case EXPR_MULT:
+		ret = maskNode(((const BinaryFunc*)e)->left().get(), memo) |
+			maskNode(((const BinaryFunc*)e)->right().get(), memo);
+		break;
+	case EXPR_UMINUS:
+		ret = maskNode(((const unaryMinus*)e)->operand().get(), memo);
+		break;
+	default:
+		break;
+	}
+	memo[e] = ret;
+	return ret;
+}
+
+unsigned long long MathFunc::varMask(const ExprP& e) {
+	unsigned long long ret;
+	varMasks(&e, 1, &ret);
+	return ret;
+}
+
+void MathFunc::varMasks(const ExprP* es, int n, unsigned long long* masks) {
+	MaskMemo memo;
+	int i;
+	for(i = 0; i < n; i++) {
+		masks[i] = maskNode(es[i].get(), memo);
+	}
 }
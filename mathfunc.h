@@ -2,19 +2,56 @@
 #define __MATHFUNC_HEADER__
 
 #include "euclid.h"
+#include <stddef.h>
+#include <atomic>
 
 using Linear::RealVec;
 
 namespace MathFunc {
 	class ExprP;
+
+	enum ExprType {
+		EXPR_CONST = 0,
+		EXPR_SIN,
+		EXPR_COS,
+		EXPR_X,
+		EXPR_MINUS,
+		EXPR_ADD,
+		EXPR_MULT,
+		EXPR_UMINUS
+	};
+
+	//Expression nodes are immutable and hash-consed: structurally equal
+	//nodes are stored once and shared through reference counted ExprP.
+	//Graphs may be built, shared and evaluated from several threads.
 	class Expr {
 	public:
+		Expr();
 		virtual ~Expr();
 
 		virtual double eval(const RealVec& v) const=0;
 		double operator()(const RealVec& v) const;
+		//Shallow copy, operands are shared
 		virtual Expr* nSelf() const=0;
-		virtual Expr* pd(int idx) const=0;
+		virtual ExprP pd(int idx) const=0;
+
+		virtual ExprType type() const=0;
+		virtual size_t hash() const=0;
+		//Structural equality, assuming operands are already hash-consed
+		virtual bool same(const Expr& e) const=0;
+
+		//Nodes come from per-size free lists instead of the heap
+		static void* operator new(size_t size);
+		static void operator delete(void* p, size_t size);
+
+	private:
+		//Copies would duplicate a hash-consed node
+		Expr(const Expr&);
+		Expr& operator=(const Expr&);
+
+		//Only drops to zero with the intern table locked, so a lookup
+		//never finds a node that is being destroyed
+		mutable std::atomic<int> ref;
 
 		friend class ExprP;
 	};
@@ -23,59 +60,45 @@ namespace MathFunc {
 	public:
 		ExprP();
 		ExprP(const ExprP& e);
+		ExprP(ExprP&& e);
 		ExprP(const Expr& e);
 		ExprP(Expr* e);
 		~ExprP();
 
 		ExprP& operator=(const ExprP& e);
+		ExprP& operator=(ExprP&& e);
 		ExprP& operator=(const Expr& e);
 		ExprP& operator=(double scalar);
-		
+
 		ExprP& operator+=(const ExprP& e);
 		ExprP& operator+=(const Expr& e);
 		ExprP& operator+=(double scalar);
-		
+
 		ExprP& operator*=(const ExprP& e);
 		ExprP& operator*=(const Expr& e);
 		ExprP& operator*=(double scalar);
-		
+
 		ExprP& operator-=(const ExprP& e);
 		ExprP& operator-=(const Expr& e);
 		ExprP& operator-=(double scalar);
 
 		double eval(const RealVec& v) const;
 		double operator()(const RealVec& v) const;
-		
+
 		ExprP pd(int idx) const;
-		
+
+		const Expr* get() const;
+		const Expr* operator->() const;
+		bool null() const;
+
+		//Number of interned nodes alive in the whole program
+		static int poolSize();
+
 	private:
-		Expr* expr;
-
-		friend ExprP operator-(const ExprP& a, const ExprP& b);
-		friend ExprP operator-(const ExprP& a);
-		friend ExprP operator+(const ExprP& a, const ExprP& b);
-		friend ExprP operator*(const ExprP& a, const ExprP& b);
-
-		friend ExprP operator-(const ExprP& a, const Expr& b);
-		friend ExprP operator-(const Expr& a, const ExprP& b);
-		friend ExprP operator+(const ExprP& a, const Expr& b);
-		friend ExprP operator+(const Expr& a, const ExprP& b);
-		friend ExprP operator*(const ExprP& a, const Expr& b);
-		friend ExprP operator*(const Expr& a, const ExprP& b);
-
-		friend ExprP operator-(const ExprP& a, double b);
-		friend ExprP operator-(double a, const ExprP& b);
-		friend ExprP operator+(const ExprP& a, double b);
-		friend ExprP operator+(double a, const ExprP& b);
-		friend ExprP operator*(const ExprP& a, double b);
-		friend ExprP operator*(double a, const ExprP& b);
-	
-		friend ExprP operator-(const Expr& a, double b);
-		friend ExprP operator-(double a, const Expr& b);
-		friend ExprP operator+(const Expr& a, double b);
-		friend ExprP operator+(double a, const Expr& b);
-		friend ExprP operator*(const Expr& a, double b);
-		friend ExprP operator*(double a, const Expr& b);
+		const Expr* expr;
+
+		static const Expr* intern(const Expr& e, Expr* owned);
+		static void release(const Expr* e);
 	};
 
 	//Constant Func
@@ -83,10 +106,16 @@ namespace MathFunc {
 	public:
 		ConstFunc();
 		ConstFunc(double cons);
-		
+
 		virtual double eval(const RealVec& v) const;
 		virtual Expr* nSelf() const;
-		virtual Expr* pd(int idx) const;
+		virtual ExprP pd(int idx) const;
+
+		virtual ExprType type() const;
+		virtual size_t hash() const;
+		virtual bool same(const Expr& e) const;
+
+		double value() const;
 
 	private:
 		double constant;
@@ -97,11 +126,16 @@ namespace MathFunc {
 	public:
 		VarFunc();
 		VarFunc(int id);
-		
+
 		virtual double eval(const RealVec& v) const;
 		virtual double eval(double x) const=0;
-		virtual Expr* d() const=0;
-		virtual Expr* pd(int idx) const;
+		virtual ExprP d() const=0;
+		virtual ExprP pd(int idx) const;
+
+		virtual size_t hash() const;
+		virtual bool same(const Expr& e) const;
+
+		int var() const;
 
 	protected:
 		int var_id;
@@ -112,19 +146,21 @@ namespace MathFunc {
 	public:
 		SinFunc();
 		SinFunc(int id);
-		
+
 		virtual double eval(double x) const;
 		virtual Expr* nSelf() const;
-		virtual Expr* d() const;
+		virtual ExprP d() const;
+		virtual ExprType type() const;
 	};
 	class CosFunc: public VarFunc {
 	public:
 		CosFunc();
 		CosFunc(int var_id);
-		
+
 		virtual double eval(double x) const;
 		virtual Expr* nSelf() const;
-		virtual Expr* d() const;
+		virtual ExprP d() const;
+		virtual ExprType type() const;
 	};
 
 	// f(x) = x
@@ -132,67 +168,81 @@ namespace MathFunc {
 	public:
 		XFunc();
 		XFunc(int id);
-		
+
 		virtual double eval(double x) const;
 		virtual Expr* nSelf() const;
-		virtual Expr* d() const;
+		virtual ExprP d() const;
+		virtual ExprType type() const;
 	};
 
-	class Minus: public Expr {
+	//Function of two operands
+	class BinaryFunc: public Expr {
+	public:
+		BinaryFunc();
+		BinaryFunc(const ExprP& a, const ExprP& b);
+		BinaryFunc(ExprP&& a, ExprP&& b);
+
+		virtual size_t hash() const;
+		virtual bool same(const Expr& e) const;
+
+		const ExprP& left() const;
+		const ExprP& right() const;
+
+	protected:
+		ExprP l, r;
+	};
+
+	class Minus: public BinaryFunc {
 	public:
 		Minus();
-		Minus(const Expr& a, const Expr& b);
-		Minus(Expr* a, Expr* b);
-		~Minus();
-		
+		Minus(const ExprP& a, const ExprP& b);
+		Minus(ExprP&& a, ExprP&& b);
+
 		virtual double eval(const RealVec& v) const;
 		virtual Expr* nSelf() const;
-		virtual Expr* pd(int idx) const;
-		
-	private:
-		Expr *l, *r;
+		virtual ExprP pd(int idx) const;
+		virtual ExprType type() const;
 	};
-	class Add: public Expr {
+	class Add: public BinaryFunc {
 	public:
 		Add();
-		Add(const Expr& a, const Expr& b);
-		Add(Expr* a, Expr* b);
-		~Add();
-		
+		Add(const ExprP& a, const ExprP& b);
+		Add(ExprP&& a, ExprP&& b);
+
 		virtual double eval(const RealVec& v) const;
 		virtual Expr* nSelf() const;
-		virtual Expr* pd(int idx) const;
-		
-	private:
-		Expr *l, *r;
+		virtual ExprP pd(int idx) const;
+		virtual ExprType type() const;
 	};
-	class Mult: public Expr {
+	class Mult: public BinaryFunc {
 	public:
 		Mult();
-		Mult(const Expr& a, const Expr& b);
-		Mult(Expr* a, Expr *b);
-		~Mult();
-		
+		Mult(const ExprP& a, const ExprP& b);
+		Mult(ExprP&& a, ExprP&& b);
+
 		virtual double eval(const RealVec& v) const;
 		virtual Expr* nSelf() const;
-		virtual Expr* pd(int idx) const;
-		
-	private:
-		Expr *l, *r;
+		virtual ExprP pd(int idx) const;
+		virtual ExprType type() const;
 	};
 	class unaryMinus: public Expr {
 	public:
 		unaryMinus();
-		unaryMinus(const Expr& a);
-		unaryMinus(Expr* a);
-		~unaryMinus();
-		
+		unaryMinus(const ExprP& a);
+		unaryMinus(ExprP&& a);
+
 		virtual double eval(const RealVec& v) const;
 		virtual Expr* nSelf() const;
-		virtual Expr* pd(int idx) const;
-		
+		virtual ExprP pd(int idx) const;
+
+		virtual ExprType type() const;
+		virtual size_t hash() const;
+		virtual bool same(const Expr& e) const;
+
+		const ExprP& operand() const;
+
 	private:
-		Expr* expr;
+		ExprP expr;
 	};
 
 	ExprP operator-(const ExprP& a, const ExprP& b);
@@ -200,6 +250,33 @@ namespace MathFunc {
 	ExprP operator+(const ExprP& a, const ExprP& b);
 	ExprP operator*(const ExprP& a, const ExprP& b);
 
+	//Temporaries are moved into the new node instead of copied
+	ExprP operator-(ExprP&& a, ExprP&& b);
+	ExprP operator-(ExprP&& a);
+	ExprP operator+(ExprP&& a, ExprP&& b);
+	ExprP operator*(ExprP&& a, ExprP&& b);
+
+	ExprP operator-(ExprP&& a, const ExprP& b);
+	ExprP operator-(const ExprP& a, ExprP&& b);
+	ExprP operator+(ExprP&& a, const ExprP& b);
+	ExprP operator+(const ExprP& a, ExprP&& b);
+	ExprP operator*(ExprP&& a, const ExprP& b);
+	ExprP operator*(const ExprP& a, ExprP&& b);
+
+	ExprP operator-(ExprP&& a, const Expr& b);
+	ExprP operator-(const Expr& a, ExprP&& b);
+	ExprP operator+(ExprP&& a, const Expr& b);
+	ExprP operator+(const Expr& a, ExprP&& b);
+	ExprP operator*(ExprP&& a, const Expr& b);
+	ExprP operator*(const Expr& a, ExprP&& b);
+
+	ExprP operator-(ExprP&& a, double b);
+	ExprP operator-(double a, ExprP&& b);
+	ExprP operator+(ExprP&& a, double b);
+	ExprP operator+(double a, ExprP&& b);
+	ExprP operator*(ExprP&& a, double b);
+	ExprP operator*(double a, ExprP&& b);
+
 	ExprP operator-(const Expr& a, const Expr& b);
 	ExprP operator-(const Expr& a);
 	ExprP operator+(const Expr& a, const Expr& b);
@@ -211,14 +288,14 @@ namespace MathFunc {
 	ExprP operator+(const Expr& a, const ExprP& b);
 	ExprP operator*(const ExprP& a, const Expr& b);
 	ExprP operator*(const Expr& a, const ExprP& b);
-	
+
 	ExprP operator-(const ExprP& a, double b);
 	ExprP operator-(double a, const ExprP& b);
 	ExprP operator+(const ExprP& a, double b);
 	ExprP operator+(double a, const ExprP& b);
 	ExprP operator*(const ExprP& a, double b);
 	ExprP operator*(double a, const ExprP& b);
-	
+
 	ExprP operator-(const Expr& a, double b);
 	ExprP operator-(double a, const Expr& b);
 	ExprP operator+(const Expr& a, double b);
@@ -226,6 +303,23 @@ namespace MathFunc {
 	ExprP operator*(const Expr& a, double b);
 	ExprP operator*(double a, const Expr& b);
 
+	//Algebraic simplification: constant folding, identity and annihilator
+	//elimination, negation folding. Batches share one memo so common
+	//subexpressions are only simplified once.
+	ExprP simplify(const ExprP& e);
+	void simplify(ExprP* es, int n);
+
+	//Number of distinct nodes reachable from the given roots
+	int nodeCount(const ExprP& e);
+	int nodeCount(const ExprP* es, int n);
+
+	//Variables an expression actually depends on, one bit per variable.
+	//Variables from VAR_MASK_BITS - 1 up share the last bit.
+	#define VAR_MASK_BITS 64
+	unsigned long long varBit(int var);
+	unsigned long long varMask(const ExprP& e);
+	void varMasks(const ExprP* es, int n, unsigned long long* masks);
+
 }
 
 #endif
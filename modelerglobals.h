@@ -9,7 +9,9 @@ enum GundanControls
 { 
 	LEVEL, LHANDX, RHANDX, LHANDZ, RHANDZ, LKNEEL, RKNEEL, 
 	LLEGX, RLEGX, LLEGZ, RLEGZ, LSHANKZ, RSHANKZ, SWORD, 
-	IKX, IKY, IKZ, LLEGXMAX, LLEGXMIN, LLEGZMAX, LLEGZMIN, LSHANKZMAX, LSHANKZMIN, IK, PIK,
+	IKX, IKY, IKZ, LLEGXMAX, LLEGXMIN, LLEGZMAX, LLEGZMIN, LSHANKZMAX, LSHANKZMIN, IK, PIK, AIK,
+	RLIKX, RLIKY, RLIKZ, LAIKX, LAIKY, LAIKZ, RAIKX, RAIKY, RAIKZ, FLATFEET, IKMETHOD,
+	IKLLEG, IKRLEG, IKLARM, IKRARM,
 	NUMCONTROLS
 };
 
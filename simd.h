@@ -0,0 +1,121 @@
+#ifndef __SIMD_HEADER__
+#define __SIMD_HEADER__
+
+//Thin wrapper over double precision SIMD lanes. AVX is used when the
+//compiler targets it, SSE2 otherwise, and plain doubles as a fallback.
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SIMD_LANES 4
+typedef __m256d vdouble;
+
+inline vdouble vset(double x) { return _mm256_set1_pd(x); }
+inline vdouble vload(const double* p) { return _mm256_loadu_pd(p); }
+inline void vstore(double* p, vdouble a) { _mm256_storeu_pd(p, a); }
+inline vdouble vadd(vdouble a, vdouble b) { return _mm256_add_pd(a, b); }
+inline vdouble vsub(vdouble a, vdouble b) { return _mm256_sub_pd(a, b); }
+inline vdouble vmul(vdouble a, vdouble b) { return _mm256_mul_pd(a, b); }
+inline vdouble vand(vdouble a, vdouble b) { return _mm256_and_pd(a, b); }
+inline vdouble vandnot(vdouble a, vdouble b) { return _mm256_andnot_pd(a, b); }
+inline vdouble vor(vdouble a, vdouble b) { return _mm256_or_pd(a, b); }
+inline vdouble vxor(vdouble a, vdouble b) { return _mm256_xor_pd(a, b); }
+inline vdouble vcmpeq(vdouble a, vdouble b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+inline vdouble vcmpgt(vdouble a, vdouble b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_LANES 2
+typedef __m128d vdouble;
+
+inline vdouble vset(double x) { return _mm_set1_pd(x); }
+inline vdouble vload(const double* p) { return _mm_loadu_pd(p); }
+inline void vstore(double* p, vdouble a) { _mm_storeu_pd(p, a); }
+inline vdouble vadd(vdouble a, vdouble b) { return _mm_add_pd(a, b); }
+inline vdouble vsub(vdouble a, vdouble b) { return _mm_sub_pd(a, b); }
+inline vdouble vmul(vdouble a, vdouble b) { return _mm_mul_pd(a, b); }
+inline vdouble vand(vdouble a, vdouble b) { return _mm_and_pd(a, b); }
+inline vdouble vandnot(vdouble a, vdouble b) { return _mm_andnot_pd(a, b); }
+inline vdouble vor(vdouble a, vdouble b) { return _mm_or_pd(a, b); }
+inline vdouble vxor(vdouble a, vdouble b) { return _mm_xor_pd(a, b); }
+inline vdouble vcmpeq(vdouble a, vdouble b) { return _mm_cmpeq_pd(a, b); }
+inline vdouble vcmpgt(vdouble a, vdouble b) { return _mm_cmpgt_pd(a, b); }
+
+#else
+#include <string.h>
+#define SIMD_LANES 1
+typedef double vdouble;
+
+inline double vbits(unsigned long long u) { double d; memcpy(&d, &u, sizeof(d)); return d; }
+inline unsigned long long vubits(double d) { unsigned long long u; memcpy(&u, &d, sizeof(u)); return u; }
+
+inline vdouble vset(double x) { return x; }
+inline vdouble vload(const double* p) { return *p; }
+inline void vstore(double* p, vdouble a) { *p = a; }
+inline vdouble vadd(vdouble a, vdouble b) { return a + b; }
+inline vdouble vsub(vdouble a, vdouble b) { return a - b; }
+inline vdouble vmul(vdouble a, vdouble b) { return a * b; }
+inline vdouble vand(vdouble a, vdouble b) { return vbits(vubits(a) & vubits(b)); }
+inline vdouble vandnot(vdouble a, vdouble b) { return vbits(~vubits(a) & vubits(b)); }
+inline vdouble vor(vdouble a, vdouble b) { return vbits(vubits(a) | vubits(b)); }
+inline vdouble vxor(vdouble a, vdouble b) { return vbits(vubits(a) ^ vubits(b)); }
+inline vdouble vcmpeq(vdouble a, vdouble b) { return vbits(a == b ? ~0ULL : 0ULL); }
+inline vdouble vcmpgt(vdouble a, vdouble b) { return vbits(a > b ? ~0ULL : 0ULL); }
+#endif
+
+//mask ? a : b
+inline vdouble vselect(vdouble mask, vdouble a, vdouble b) {
+	return vor(vand(mask, a), vandnot(mask, b));
+}
+
+inline vdouble vneg(vdouble a) {
+	return vxor(a, vset(-0.0));
+}
+
+//Round to nearest, valid for |a| < 2^51
+inline vdouble vround(vdouble a) {
+	const vdouble magic = vset(6755399441055744.0);
+	return vsub(vadd(a, magic), magic);
+}
+
+inline vdouble vfloor(vdouble a) {
+	vdouble r = vround(a);
+	return vsub(r, vand(vcmpgt(r, a), vset(1.0)));
+}
+
+//Cephes style sine and cosine of the same argument. The argument is
+//reduced by multiples of pi/2 in three parts, then both polynomials
+//are evaluated on [-pi/4, pi/4] and swapped/negated per quadrant.
+inline void vsincos(vdouble x, vdouble& s, vdouble& c) {
+	vdouble q, r, z, ps, pc, m, swap;
+	q = vround(vmul(x, vset(0.63661977236758134308)));
+	r = vsub(x, vmul(q, vset(1.57079625129699707031)));
+	r = vsub(r, vmul(q, vset(7.54978941586159635335E-8)));
+	r = vsub(r, vmul(q, vset(5.39030285815811905290E-15)));
+	z = vmul(r, r);
+
+	ps = vset(1.58962301576546568060E-10);
+	ps = vadd(vmul(ps, z), vset(-2.50507477628578072866E-8));
+	ps = vadd(vmul(ps, z), vset(2.75573136213857245213E-6));
+	ps = vadd(vmul(ps, z), vset(-1.98412698295895385996E-4));
+	ps = vadd(vmul(ps, z), vset(8.33333333332211858878E-3));
+	ps = vadd(vmul(ps, z), vset(-1.66666666666666307295E-1));
+	ps = vadd(r, vmul(vmul(r, z), ps));
+
+	pc = vset(-1.13585365213876817300E-11);
+	pc = vadd(vmul(pc, z), vset(2.08757008419747316778E-9));
+	pc = vadd(vmul(pc, z), vset(-2.75573141792967388112E-7));
+	pc = vadd(vmul(pc, z), vset(2.48015872888517045348E-5));
+	pc = vadd(vmul(pc, z), vset(-1.38888888888730564116E-3));
+	pc = vadd(vmul(pc, z), vset(4.16666666666665929218E-2));
+	pc = vadd(vsub(vset(1.0), vmul(vset(0.5), z)), vmul(vmul(z, z), pc));
+
+	//quadrant q mod 4
+	m = vsub(q, vmul(vset(4.0), vfloor(vmul(q, vset(0.25)))));
+	swap = vor(vcmpeq(m, vset(1.0)), vcmpeq(m, vset(3.0)));
+	s = vselect(swap, pc, ps);
+	c = vselect(swap, ps, pc);
+	s = vselect(vcmpgt(m, vset(1.5)), vneg(s), s);
+	c = vselect(vor(vcmpeq(m, vset(1.0)), vcmpeq(m, vset(2.0))), vneg(c), c);
+}
+
+#endif
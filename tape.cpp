@@ -0,0 +1,622 @@
+#include "tape.h"
+#include "simd.h"
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <unordered_map>
+
+using namespace MathFunc;
+
+typedef std::unordered_map<const Expr*, int> RegMap;
+
+//sin and cos of n values, SIMD_LANES at a time
+static void sinCosTable(const double* v, int n, double* s, double* c) {
+	double in[SIMD_LANES], os[SIMD_LANES], oc[SIMD_LANES];
+	vdouble vs, vc;
+	int i, k;
+	for(i = 0; i < n; i += SIMD_LANES) {
+		for(k = 0; k < SIMD_LANES; k++) {
+			in[k] = i + k < n ? v[i + k] : 0;
+		}
+		vsincos(vload(in), vs, vc);
+		vstore(os, vs);
+		vstore(oc, vc);
+		for(k = 0; k < SIMD_LANES && i + k < n; k++) {
+			s[i + k] = os[k];
+			c[i + k] = oc[k];
+		}
+	}
+}
+
+static int lower(const ExprP& e, std::vector<TapeInst>& code, RegMap& regs, int& nvars) {
+	RegMap::iterator it = regs.find(e.get());
+	const BinaryFunc* b;
+	TapeInst inst;
+	if(it != regs.end()) {
+		return it->second;
+	}
+	inst.a = inst.b = 0;
+	inst.c = 0;
+	switch(e->type()) {
+	case EXPR_CONST:
+		inst.op = OP_CONST;
+		inst.c = ((const ConstFunc*)e.get())->value();
+		break;
+	case EXPR_SIN:
+	case EXPR_COS:
+	case EXPR_X:
+		inst.op = e->type() == EXPR_SIN ? OP_SIN : (e->type() == EXPR_COS ? OP_COS : OP_X);
+		inst.a = ((const VarFunc*)e.get())->var();
+		if(inst.a + 1 > nvars) {
+			nvars = inst.a + 1;
+		}
+		break;
+	case EXPR_ADD:
+	case EXPR_MINUS:
+	case EXPR_MULT:
+		b = (const BinaryFunc*)e.get();
+		inst.op = e->type() == EXPR_ADD ? OP_ADD : (e->type() == EXPR_MINUS ? OP_SUB : OP_MUL);
+		inst.a = lower(b->left(), code, regs, nvars);
+		inst.b = lower(b->right(), code, regs, nvars);
+		break;
+	case EXPR_UMINUS:
+		inst.op = OP_NEG;
+		inst.a = lower(((const unaryMinus*)e.get())->operand(), code, regs, nvars);
+		break;
+	}
+	code.push_back(inst);
+	regs[e.get()] = (int)code.size() - 1;
+	return (int)code.size() - 1;
+}
+
+Tape::Tape(): nvars(0) {}
+Tape::Tape(const ExprP& e): nvars(0) {
+	compile(&e, 1);
+}
+Tape::Tape(const ExprP* es, int n): nvars(0) {
+	compile(es, n);
+}
+
+static unsigned long long depsOf(const TapeInst& p, const std::vector<unsigned long long>& deps) {
+	switch(p.op) {
+	case OP_SIN:
+	case OP_COS:
+	case OP_X:
+		return varBit(p.a);
+	case OP_ADD:
+	case OP_SUB:
+	case OP_MUL:
+		return deps[p.a] | deps[p.b];
+	case OP_NEG:
+		return deps[p.a];
+	}
+	return 0;
+}
+
+//Register i of the program, given the sin/cos table
+static inline void evalInst(const TapeInst* p, int i, const double* v, const double* ts, const double* tc, double* regs) {
+	switch(p->op) {
+	case OP_CONST:
+		regs[i] = p->c;
+		break;
+	case OP_SIN:
+		regs[i] = ts[p->a];
+		break;
+	case OP_COS:
+		regs[i] = tc[p->a];
+		break;
+	case OP_X:
+		regs[i] = v[p->a];
+		break;
+	case OP_ADD:
+		regs[i] = regs[p->a] + regs[p->b];
+		break;
+	case OP_SUB:
+		regs[i] = regs[p->a] - regs[p->b];
+		break;
+	case OP_MUL:
+		regs[i] = regs[p->a] * regs[p->b];
+		break;
+	case OP_NEG:
+		regs[i] = -regs[p->a];
+		break;
+	}
+}
+
+void Tape::compile(const ExprP* es, int n) {
+	RegMap regs;
+	int i, j;
+	code.clear();
+	outs.clear();
+	nvars = 0;
+	for(i = 0; i < n; i++) {
+		outs.push_back(lower(es[i], code, regs, nvars));
+	}
+
+	deps.assign(code.size(), 0);
+	users.assign(nvars < VAR_MASK_BITS ? nvars : VAR_MASK_BITS, std::vector<int>());
+	for(i = 0; i < (int)code.size(); i++) {
+		deps[i] = depsOf(code[i], deps);
+		for(j = 0; j < (int)users.size(); j++) {
+			if(deps[i] & (1ULL << j)) {
+				users[j].push_back(i);
+			}
+		}
+	}
+}
+
+int Tape::size() const {
+	return (int)code.size();
+}
+
+int Tape::outputs() const {
+	return (int)outs.size();
+}
+
+int Tape::vars() const {
+	return nvars;
+}
+
+int Tape::workSize() const {
+	return (int)code.size() + 2 * nvars;
+}
+
+int Tape::reverseWorkSize() const {
+	return workSize() + (int)code.size();
+}
+
+int Tape::forwardWorkSize(int nv) const {
+	return workSize() + (int)code.size() * nv;
+}
+
+double Tape::eval(const RealVec& v) const {
+	double ret;
+	eval(v, &ret);
+	return ret;
+}
+
+void Tape::eval(const RealVec& v, double* out) const {
+	std::vector<double> regs(workSize());
+	assert(v.dim() >= nvars);
+	if(code.empty()) {
+		return;
+	}
+	eval(v.dim() > 0 ? &v[0] : NULL, &regs[0], out);
+}
+
+void Tape::eval(const double* v, double* regs, double* out) const {
+	const TapeInst* p = code.empty() ? NULL : &code[0];
+	const int n = (int)code.size();
+	double *ts = regs + n, *tc = regs + n + nvars;
+	int i;
+	sinCosTable(v, nvars, ts, tc);
+	for(i = 0; i < n; i++, p++) {
+		evalInst(p, i, v, ts, tc, regs);
+	}
+	for(i = 0; i < (int)outs.size(); i++) {
+		out[i] = regs[outs[i]];
+	}
+}
+
+int Tape::update(const double* v, unsigned long long changed, double* regs, double* out) const {
+	const int n = (int)code.size();
+	double *ts = regs + n, *tc = regs + n + nvars;
+	const std::vector<int>* list = NULL;
+	int i, k, count = 0;
+	for(i = 0; i < nvars; i++) {
+		if(changed & varBit(i)) {
+			sinCosTable(v + i, 1, ts + i, tc + i);
+		}
+	}
+	//A single variable walks its own list, several test every mask
+	for(k = 0; k < (int)users.size(); k++) {
+		if(changed == (1ULL << k)) {
+			list = &users[k];
+		}
+	}
+	if(list) {
+		for(k = 0; k < (int)list->size(); k++) {
+			i = (*list)[k];
+			evalInst(&code[i], i, v, ts, tc, regs);
+		}
+		count = (int)list->size();
+	}
+	else if(changed) {
+		for(i = 0; i < n; i++) {
+			if(deps[i] & changed) {
+				evalInst(&code[i], i, v, ts, tc, regs);
+				count++;
+			}
+		}
+	}
+	for(i = 0; i < (int)outs.size(); i++) {
+		out[i] = regs[outs[i]];
+	}
+	return count;
+}
+
+double Tape::gradient(const RealVec& v, double* grad) const {
+	std::vector<double> out(outs.size()), work(reverseWorkSize());
+	assert(!outs.empty() && v.dim() >= nvars);
+	eval(v.dim() > 0 ? &v[0] : NULL, &work[0], &out[0]);
+	backward(v.dim(), 0, &work[0], &work[workSize()], grad);
+	return out[0];
+}
+
+void Tape::jacobian(const RealVec& v, double* out, double* jac) const {
+	std::vector<double> work(reverseWorkSize());
+	assert(v.dim() >= nvars);
+	if(code.empty()) {
+		return;
+	}
+	jacobian(v.dim() > 0 ? &v[0] : NULL, v.dim(), &work[0], out, jac);
+}
+
+void Tape::jacobian(const double* v, int nv, double* work, double* out, double* jac) const {
+	int i;
+	eval(v, work, out);
+	for(i = 0; i < (int)outs.size(); i++) {
+		backward(nv, i, work, work + workSize(), jac + i * nv);
+	}
+}
+
+//Propagates adjoints from one output back to the variables. Registers
+//only feed later registers, so a single reverse pass suffices. The trig
+//table of the forward sweep provides the leaf derivatives.
+void Tape::backward(int nv, int output, const double* regs, double* adj, double* grad) const {
+	const TapeInst* p;
+	const double *ts = regs + code.size(), *tc = regs + code.size() + nvars;
+	double g;
+	int i;
+	memset(adj, 0, sizeof(double) * code.size());
+	memset(grad, 0, sizeof(double) * nv);
+	adj[outs[output]] = 1.0;
+	for(i = outs[output]; i >= 0; i--) {
+		g = adj[i];
+		if(g == 0) {
+			continue;
+		}
+		p = &code[i];
+		switch(p->op) {
+		case OP_CONST:
+			break;
+		case OP_SIN:
+			grad[p->a] += g * tc[p->a];
+			break;
+		case OP_COS:
+			grad[p->a] -= g * ts[p->a];
+			break;
+		case OP_X:
+			grad[p->a] += g;
+			break;
+		case OP_ADD:
+			adj[p->a] += g;
+			adj[p->b] += g;
+			break;
+		case OP_SUB:
+			adj[p->a] += g;
+			adj[p->b] -= g;
+			break;
+		case OP_MUL:
+			adj[p->a] += g * regs[p->b];
+			adj[p->b] += g * regs[p->a];
+			break;
+		case OP_NEG:
+			adj[p->a] -= g;
+			break;
+		}
+	}
+}
+
+void Tape::forward(const RealVec& v, double* out, double* jac) const {
+	std::vector<double> work(forwardWorkSize(v.dim()));
+	assert(v.dim() >= nvars);
+	if(code.empty()) {
+		return;
+	}
+	forward(v.dim() > 0 ? &v[0] : NULL, v.dim(), &work[0], out, jac);
+}
+
+//Registers and trig table first, then nv tangents per register
+void Tape::forward(const double* v, int nv, double* work, double* out, double* jac) const {
+	const int n = (int)code.size();
+	const TapeInst* p;
+	double *r, *t, *ta, *tb, *ts, *tc, *tangent;
+	int i, k;
+	r = work;
+	ts = r + n;
+	tc = r + n + nvars;
+	tangent = work + workSize();
+	sinCosTable(v, nvars, ts, tc);
+	for(i = 0; i < n; i++) {
+		p = &code[i];
+		t = tangent + i * nv;
+		ta = tangent + p->a * nv;
+		tb = tangent + p->b * nv;
+		switch(p->op) {
+		case OP_CONST:
+			r[i] = p->c;
+			memset(t, 0, sizeof(double) * nv);
+			break;
+		case OP_SIN:
+			r[i] = ts[p->a];
+			memset(t, 0, sizeof(double) * nv);
+			t[p->a] = tc[p->a];
+			break;
+		case OP_COS:
+			r[i] = tc[p->a];
+			memset(t, 0, sizeof(double) * nv);
+			t[p->a] = -ts[p->a];
+			break;
+		case OP_X:
+			r[i] = v[p->a];
+			memset(t, 0, sizeof(double) * nv);
+			t[p->a] = 1.0;
+			break;
+		case OP_ADD:
+			r[i] = r[p->a] + r[p->b];
+			for(k = 0; k < nv; k++) {
+				t[k] = ta[k] + tb[k];
+			}
+			break;
+		case OP_SUB:
+			r[i] = r[p->a] - r[p->b];
+			for(k = 0; k < nv; k++) {
+				t[k] = ta[k] - tb[k];
+			}
+			break;
+		case OP_MUL:
+			r[i] = r[p->a] * r[p->b];
+			for(k = 0; k < nv; k++) {
+				t[k] = ta[k] * r[p->b] + r[p->a] * tb[k];
+			}
+			break;
+		case OP_NEG:
+			r[i] = -r[p->a];
+			for(k = 0; k < nv; k++) {
+				t[k] = -ta[k];
+			}
+			break;
+		}
+	}
+	for(i = 0; i < (int)outs.size(); i++) {
+		out[i] = r[outs[i]];
+		memcpy(jac + i * nv, tangent + outs[i] * nv, sizeof(double) * nv);
+	}
+}
+
+void Tape::evalBatch(const double* const* theta, int n, double* const* out) const {
+	std::vector<double> in(nvars * TAPE_BLOCK + 1), regs(workSize() * TAPE_BLOCK + 1);
+	int base, cnt, i;
+	for(base = 0; base < n; base += TAPE_BLOCK) {
+		cnt = n - base < TAPE_BLOCK ? n - base : TAPE_BLOCK;
+		for(i = 0; i < nvars; i++) {
+			memcpy(&in[i * TAPE_BLOCK], theta[i] + base, sizeof(double) * cnt);
+			memset(&in[i * TAPE_BLOCK + cnt], 0, sizeof(double) * (TAPE_BLOCK - cnt));
+		}
+		evalBlock(&in[0], &regs[0]);
+		for(i = 0; i < (int)outs.size(); i++) {
+			memcpy(out[i] + base, &regs[outs[i] * TAPE_BLOCK], sizeof(double) * cnt);
+		}
+	}
+}
+
+//Runs the tape once over TAPE_BLOCK lanes, register i of lane k is
+//regs[i * TAPE_BLOCK + k]. The sin/cos rows of every variable follow
+//the registers and are filled first.
+void Tape::evalBlock(const double* in, double* regs) const {
+	const int n = (int)code.size();
+	const TapeInst* p;
+	double *d, *a, *b;
+	double *ts = regs + n * TAPE_BLOCK, *tc = regs + (n + nvars) * TAPE_BLOCK;
+	vdouble s, c;
+	int i, k;
+	for(i = 0; i < nvars; i++) {
+		for(k = 0; k < TAPE_BLOCK; k += SIMD_LANES) {
+			vsincos(vload(in + i * TAPE_BLOCK + k), s, c);
+			vstore(ts + i * TAPE_BLOCK + k, s);
+			vstore(tc + i * TAPE_BLOCK + k, c);
+		}
+	}
+	for(i = 0; i < n; i++) {
+		p = &code[i];
+		d = regs + i * TAPE_BLOCK;
+		a = regs + p->a * TAPE_BLOCK;
+		b = regs + p->b * TAPE_BLOCK;
+		switch(p->op) {
+		case OP_CONST:
+			for(k = 0; k < TAPE_BLOCK; k += SIMD_LANES) {
+				vstore(d + k, vset(p->c));
+			}
+			break;
+		case OP_SIN:
+			memcpy(d, ts + p->a * TAPE_BLOCK, sizeof(double) * TAPE_BLOCK);
+			break;
+		case OP_COS:
+			memcpy(d, tc + p->a * TAPE_BLOCK, sizeof(double) * TAPE_BLOCK);
+			break;
+		case OP_X:
+			memcpy(d, in + p->a * TAPE_BLOCK, sizeof(double) * TAPE_BLOCK);
+			break;
+		case OP_ADD:
+			for(k = 0; k < TAPE_BLOCK; k += SIMD_LANES) {
+				vstore(d + k, vadd(vload(a + k), vload(b + k)));
+			}
+			break;
+		case OP_SUB:
+			for(k = 0; k < TAPE_BLOCK; k += SIMD_LANES) {
+				vstore(d + k, vsub(vload(a + k), vload(b + k)));
+			}
+			break;
+		case OP_MUL:
+			for(k = 0; k < TAPE_BLOCK; k += SIMD_LANES) {
+				vstore(d + k, vmul(vload(a + k), vload(b + k)));
+			}
+			break;
+		case OP_NEG:
+			for(k = 0; k < TAPE_BLOCK; k += SIMD_LANES) {
+				vstore(d + k, vneg(vload(a + k)));
+			}
+			break;
+		}
+	}
+}
+
+void Tape::evalInterval(const Interval* box, Interval* regs, Interval* out) const {
+	const TapeInst* p = code.empty() ? NULL : &code[0];
+	const int n = (int)code.size();
+	int i;
+	for(i = 0; i < n; i++, p++) {
+		switch(p->op) {
+		case OP_CONST:
+			regs[i] = Interval(p->c);
+			break;
+		case OP_SIN:
+			regs[i] = isin(box[p->a]);
+			break;
+		case OP_COS:
+			regs[i] = icos(box[p->a]);
+			break;
+		case OP_X:
+			regs[i] = box[p->a];
+			break;
+		case OP_ADD:
+			regs[i] = regs[p->a] + regs[p->b];
+			break;
+		case OP_SUB:
+			regs[i] = regs[p->a] - regs[p->b];
+			break;
+		case OP_MUL:
+			regs[i] = regs[p->a] * regs[p->b];
+			break;
+		case OP_NEG:
+			regs[i] = -regs[p->a];
+			break;
+		}
+	}
+	for(i = 0; i < (int)outs.size(); i++) {
+		out[i] = regs[outs[i]];
+	}
+}
+
+unsigned int Tape::hash() const {
+	unsigned int h = 2166136261u;
+	const unsigned char* c;
+	int i, k;
+	for(i = 0; i < (int)code.size(); i++) {
+		h = (h ^ code[i].op) * 16777619u;
+		h = (h ^ code[i].a) * 16777619u;
+		h = (h ^ code[i].b) * 16777619u;
+		c = (const unsigned char*)&code[i].c;
+		for(k = 0; k < (int)sizeof(double); k++) {
+			h = (h ^ c[k]) * 16777619u;
+		}
+	}
+	for(i = 0; i < (int)outs.size(); i++) {
+		h = (h ^ outs[i]) * 16777619u;
+	}
+	return h;
+}
+
+//Operand text of register r: constants are inlined, everything else
+//was given a local. %g prints nan and inf, which do not compile, so
+//those are written as the math.h macros.
+static void writeOperand(FILE* f, const std::vector<TapeInst>& code, int r) {
+	double c = code[r].c;
+	if(code[r].op == OP_CONST && c != c) {
+		fprintf(f, "NAN");
+	}
+	else if(code[r].op == OP_CONST && (c > DBL_MAX || c < -DBL_MAX)) {
+		fprintf(f, c < 0 ? "(-INFINITY)" : "INFINITY");
+	}
+	else if(code[r].op == OP_CONST) {
+		fprintf(f, c < 0 ? "(%.17g)" : "%.17g", c);
+	}
+	else {
+		fprintf(f, "r%d", r);
+	}
+}
+
+void Tape::writeCpp(FILE* f, const char* name) const {
+	std::vector<bool> trig(nvars, false);
+	const TapeInst* p;
+	int i;
+	for(i = 0; i < (int)code.size(); i++) {
+		if(code[i].op == OP_SIN || code[i].op == OP_COS) {
+			trig[code[i].a] = true;
+		}
+	}
+	fprintf(f, "inline void %s(const double* v, double* out) {\n", name);
+	for(i = 0; i < nvars; i++) {
+		if(trig[i]) {
+			fprintf(f, "\tconst double s%d = sin(v[%d]), c%d = cos(v[%d]);\n", i, i, i, i);
+		}
+	}
+	for(i = 0; i < (int)code.size(); i++) {
+		p = &code[i];
+		if(p->op == OP_CONST) {
+			continue;
+		}
+		fprintf(f, "\tconst double r%d = ", i);
+		switch(p->op) {
+		case OP_SIN:
+			fprintf(f, "s%d", p->a);
+			break;
+		case OP_COS:
+			fprintf(f, "c%d", p->a);
+			break;
+		case OP_X:
+			fprintf(f, "v[%d]", p->a);
+			break;
+		case OP_ADD:
+		case OP_SUB:
+		case OP_MUL:
+			writeOperand(f, code, p->a);
+			fprintf(f, p->op == OP_ADD ? " + " : (p->op == OP_SUB ? " - " : " * "));
+			writeOperand(f, code, p->b);
+			break;
+		case OP_NEG:
+			fprintf(f, "-");
+			writeOperand(f, code, p->a);
+			break;
+		}
+		fprintf(f, ";\n");
+	}
+	for(i = 0; i < (int)outs.size(); i++) {
+		fprintf(f, "\tout[%d] = ", i);
+		writeOperand(f, code, outs[i]);
+		fprintf(f, ";\n");
+	}
+	fprintf(f, "}\n");
+}
+
+TapeState::TapeState(): count(0) {}
+
+void TapeState::reset() {
+	regs.clear();
+	last.clear();
+}
+
+void TapeState::eval(const Tape& t, const RealVec& v, double* out) {
+	unsigned long long changed = 0;
+	int i;
+	assert(v.dim() >= t.vars());
+	if((int)regs.size() != t.workSize() + 1 || (int)last.size() != v.dim()) {
+		regs.assign(t.workSize() + 1, 0);
+		last.assign(v.dim() > 0 ? &v[0] : NULL, v.dim() > 0 ? &v[0] + v.dim() : NULL);
+		t.eval(last.empty() ? NULL : &last[0], &regs[0], out);
+		count = t.size();
+		return;
+	}
+	for(i = 0; i < t.vars(); i++) {
+		if(v[i] != last[i]) {
+			changed |= varBit(i);
+			last[i] = v[i];
+		}
+	}
+	count = t.update(&last[0], changed, &regs[0], out);
+}
+
+int TapeState::updated() const {
+	return count;
+}
@@ -0,0 +1,125 @@
+#ifndef __TAPE_HEADER__
+#define __TAPE_HEADER__
+
+#include "mathfunc.h"
+#include "interval.h"
+#include <stdio.h>
+#include <vector>
+
+//Lanes evaluated per instruction dispatch in Tape::evalBatch
+#define TAPE_BLOCK 16
+
+namespace MathFunc {
+	enum TapeOp {
+		OP_CONST = 0,
+		OP_SIN,
+		OP_COS,
+		OP_X,
+		OP_ADD,
+		OP_SUB,
+		OP_MUL,
+		OP_NEG
+	};
+
+	//One instruction writes one register. a, b are operand registers,
+	//or a is the variable id for OP_SIN/OP_COS/OP_X.
+	struct TapeInst {
+		int op;
+		int a, b;
+		double c;
+	};
+
+	//Linear register program lowered from a batch of expressions.
+	//Shared subexpressions of the batch are computed once, and sin/cos
+	//of each variable once per evaluation, whatever the number of
+	//SinFunc/CosFunc leaves. A compiled tape is never written to while
+	//evaluating: work memory comes from the caller, or is allocated per
+	//call, so one tape can be evaluated from several threads.
+	class Tape {
+	public:
+		Tape();
+		Tape(const ExprP& e);
+		Tape(const ExprP* es, int n);
+
+		void compile(const ExprP* es, int n);
+
+		int size() const;
+		int outputs() const;
+		int vars() const;
+		//Registers plus the sin/cos table of every variable
+		int workSize() const;
+		//Work memory of jacobian/forward for nv variables
+		int reverseWorkSize() const;
+		int forwardWorkSize(int nv) const;
+
+		double eval(const RealVec& v) const;
+		void eval(const RealVec& v, double* out) const;
+		//regs must hold workSize() doubles
+		void eval(const double* v, double* regs, double* out) const;
+
+		//Structure of arrays: theta[var][k] is variable var of the k-th
+		//parameter vector, out[i][k] receives output i for it.
+		void evalBatch(const double* const* theta, int n, double* const* out) const;
+
+		//Enclosure of every output while variable i ranges over box[i].
+		//regs must hold size() intervals.
+		void evalInterval(const Interval* box, Interval* regs, Interval* out) const;
+
+		//Re-evaluation after the variables in the changed mask (see
+		//varBit) moved.
+		//regs must hold a previous evaluation at the old values; only
+		//registers depending on a changed variable are recomputed, and
+		//their number is returned.
+		int update(const double* v, unsigned long long changed, double* regs, double* out) const;
+
+		//Reverse mode: one forward sweep, then one backward sweep per
+		//output. grad/jac have v.dim() columns, jac is row major.
+		double gradient(const RealVec& v, double* grad) const;
+		void jacobian(const RealVec& v, double* out, double* jac) const;
+		//work must hold reverseWorkSize() doubles
+		void jacobian(const double* v, int nv, double* work, double* out, double* jac) const;
+
+		//Forward mode: every register carries its value and v.dim()
+		//tangents, so the whole Jacobian comes out of a single sweep.
+		void forward(const RealVec& v, double* out, double* jac) const;
+		//work must hold forwardWorkSize(nv) doubles
+		void forward(const double* v, int nv, double* work, double* out, double* jac) const;
+
+		//Structural hash of the program, identifies generated code
+		unsigned int hash() const;
+		//Writes the tape as straight-line C++:
+		//inline void name(const double* v, double* out)
+		void writeCpp(FILE* f, const char* name) const;
+
+	private:
+		void evalBlock(const double* in, double* regs) const;
+		void backward(int nv, int output, const double* regs, double* adj, double* grad) const;
+
+		std::vector<TapeInst> code;
+		std::vector<int> outs;
+		int nvars;
+		//Variables each register depends on, and for each bit the
+		//registers depending on it, in program order
+		std::vector<unsigned long long> deps;
+		std::vector<std::vector<int> > users;
+	};
+
+	//Register values of the previous evaluation of a tape, so that
+	//moving one variable only recomputes the subgraphs that use it
+	class TapeState {
+	public:
+		TapeState();
+
+		//Forget the cached values, needed after the tape is recompiled
+		void reset();
+		void eval(const Tape& t, const RealVec& v, double* out);
+		//Registers recomputed by the last eval
+		int updated() const;
+
+	private:
+		std::vector<double> regs, last;
+		int count;
+	};
+}
+
+#endif